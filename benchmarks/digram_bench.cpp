@@ -0,0 +1,181 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <unordered_map>
+
+#include "predictor.hpp"
+#include "utils/hashing.hpp"
+#include "utils/digram_table.hpp"
+#include "jdtests/timer.hpp"
+
+using namespace pIOn;
+
+namespace bench
+{
+	struct op_t
+	{
+		enum : uint8_t { FIND, SET, ERASE } type;
+		uint64_t first;
+		uint64_t second;
+	};
+
+	// Mimics the index traffic of Predictor::insert: mostly lookups of fresh digrams,
+	// with sets and deletes of the digrams that are currently in the grammar
+	std::vector<op_t> makeWorkload(size_t digrams, size_t ops, uint64_t alphabet)
+	{
+		std::mt19937_64 gen{ 42 };
+		std::vector<op_t> result;
+		result.reserve(digrams + ops);
+
+		std::vector<std::pair<uint64_t, uint64_t>> live;
+		live.reserve(digrams);
+		for (size_t i = 0; i < digrams; ++i) {
+			live.emplace_back(1 + gen() % alphabet, 1 + gen() % alphabet);
+			result.push_back({ op_t::SET, live.back().first, live.back().second });
+		}
+
+		for (size_t i = 0; i < ops; ++i) {
+			const auto roll = gen() % 8;
+			if (roll < 5) {
+				if (roll < 2) {
+					const auto& d = live[gen() % live.size()];
+					result.push_back({ op_t::FIND, d.first, d.second });
+				}
+				else {
+					result.push_back({ op_t::FIND, 1 + gen() % alphabet, 1 + gen() % alphabet });
+				}
+			}
+			else if (roll < 7) {
+				auto& d = live[gen() % live.size()];
+				result.push_back({ op_t::ERASE, d.first, d.second });
+				d = { 1 + gen() % alphabet, 1 + gen() % alphabet };
+				result.push_back({ op_t::SET, d.first, d.second });
+			}
+			else {
+				const auto& d = live[gen() % live.size()];
+				result.push_back({ op_t::SET, d.first, d.second });
+			}
+		}
+
+		return result;
+	}
+
+	// Values are only compared, never dereferenced
+	inline int* valueOf(const op_t& op) noexcept
+	{
+		return reinterpret_cast<int*>(static_cast<uintptr_t>((op.first ^ op.second) | 1ULL) << 3);
+	}
+
+	double runUnorderedMap(const std::vector<op_t>& ops, size_t& hits)
+	{
+		std::unordered_map<std::pair<uint64_t, uint64_t>, int*> index;
+		jd::timer::Timer clock;
+		hits = 0;
+
+		clock.start();
+		for (const op_t& op : ops) {
+			std::pair<uint64_t, uint64_t> key(op.first, op.second);
+			switch (op.type)
+			{
+			case op_t::FIND:
+				hits += index.find(key) != index.end();
+				break;
+			case op_t::SET:
+				index[key] = valueOf(op);
+				break;
+			case op_t::ERASE:
+				if (auto it = index.find(key); it != index.end() && it->second == valueOf(op)) {
+					index.erase(it);
+				}
+				break;
+			}
+		}
+		clock.stop();
+
+		return clock.time();
+	}
+
+	double runDigramTable(const std::vector<op_t>& ops, size_t& hits, size_t presize)
+	{
+		utils::DigramTable<int*> index{ presize };
+		jd::timer::Timer clock;
+		hits = 0;
+
+		clock.start();
+		for (const op_t& op : ops) {
+			switch (op.type)
+			{
+			case op_t::FIND:
+				hits += index.find(op.first, op.second) != nullptr;
+				break;
+			case op_t::SET:
+				index.assign(op.first, op.second, valueOf(op));
+				break;
+			case op_t::ERASE:
+				index.erase(op.first, op.second, valueOf(op));
+				break;
+			}
+		}
+		clock.stop();
+
+		return clock.time();
+	}
+
+	double runPredictor(size_t n, uint64_t alphabet, size_t limit)
+	{
+		std::mt19937_64 gen{ 7 };
+		std::vector<uint64_t> symbols(n);
+		for (auto& s : symbols) {
+			s = 1 + gen() % alphabet;
+		}
+
+		sequitur::Predictor predictor;
+		predictor.setLimits(limit);
+		jd::timer::Timer clock;
+
+		clock.start();
+		for (auto s : symbols) {
+			predictor.insert(s);
+		}
+		clock.stop();
+
+		return clock.time();
+	}
+}
+
+int main(void)
+{
+	constexpr size_t OPS = 2'000'000;
+	std::cout << std::setw(10) << "digrams" << std::setw(12) << "alphabet"
+		<< std::setw(18) << "unordered_map,us" << std::setw(18) << "DigramTable,us" << std::setw(10) << "speedup" << std::endl;
+
+	for (size_t digrams : { 1'000ULL, 10'000ULL, 100'000ULL, 1'000'000ULL }) {
+		for (uint64_t alphabet : { 64ULL, 4096ULL }) {
+			const auto ops = bench::makeWorkload(digrams, OPS, alphabet);
+			size_t hits_map{}, hits_table{};
+
+			const double t_map = bench::runUnorderedMap(ops, hits_map);
+			const double t_table = bench::runDigramTable(ops, hits_table, digrams);
+
+			if (hits_map != hits_table) {
+				std::cerr << "Containers disagree: " << hits_map << " != " << hits_table << std::endl;
+				return 1;
+			}
+
+			std::cout << std::fixed << std::setw(10) << digrams << std::setw(12) << alphabet
+				<< std::setprecision(0) << std::setw(18) << t_map << std::setw(18) << t_table
+				<< std::setprecision(2) << std::setw(10) << t_map / t_table << std::endl;
+		}
+	}
+
+	std::cout << "\nPredictor::insert, 20000 symbols" << std::endl;
+	for (uint64_t alphabet : { 64ULL, 4096ULL }) {
+		for (size_t limit : { 500ULL, 2'000ULL, 8'000ULL }) {
+			std::cout << "alphabet = " << std::setw(5) << alphabet << ", limit = " << std::setw(6) << limit << ": "
+				<< std::setprecision(0) << bench::runPredictor(20'000, alphabet, limit) << " us" << std::endl;
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <string_view>
+#include <cstdlib>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "model/io_prophet.hpp"
+#include "jdtests/timer.hpp"
+
+using namespace pIOn;
+
+namespace bench
+{
+	// Peak resident set of the process in bytes
+	size_t peakRss() noexcept
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+			return counters.PeakWorkingSetSize;
+		}
+		return 0;
+#else
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) != 0) {
+			return 0;
+		}
+#if defined(__APPLE__)
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	// A few processes reading files in loops of different lengths, with random reads in between
+	std::vector<blk_info_t> makeTrace(size_t n)
+	{
+		std::mt19937_64 gen{ 11 };
+		std::vector<blk_info_t> result;
+		result.reserve(n);
+
+		BlkInfoBuilder builder;
+		for (size_t i = 0; i < n; ++i) {
+			const uint64_t stream = gen() % 8;
+			const uint64_t lba = gen() % 10 == 0
+				? gen() % 100'000
+				: stream * 1'000'000 + (i / 8) % (16 + stream * 24) * 8;
+			result.push_back(builder.setSector(lba).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+
+		return result;
+	}
+
+	void run(model::grammar_storage_t storage, size_t requests)
+	{
+		const auto trace = makeTrace(requests);
+
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = requests + 1; // the index is presized for the limit
+		config.storage_ = storage;
+		model::IOProphet prophet{ config };
+
+		jd::timer::Timer clock;
+		clock.start();
+		prophet.insert_batch(trace);
+		clock.stop();
+
+		const auto stats = prophet.getGrammarStats();
+		const auto usage = prophet.memory_usage();
+		const double symbols = static_cast<double>(std::max<size_t>(stats.symbols, 1));
+		constexpr double KB = 1024.0;
+
+		std::cout << std::fixed << std::setprecision(0)
+			<< std::setw(9) << (storage == model::grammar_storage_t::LINKED ? "linked" : "compact")
+			<< std::setw(10) << requests
+			<< std::setw(10) << stats.symbols
+			<< std::setw(8) << stats.rules
+			<< std::setw(10) << usage.total() / KB
+			<< std::setprecision(1) << std::setw(10) << usage.total() / symbols
+			<< std::setw(9) << usage.symbols / symbols
+			<< std::setw(8) << usage.rules / symbols
+			<< std::setw(8) << usage.digram_index / symbols
+			<< std::setw(8) << usage.occurrences / symbols
+			<< std::setw(8) << usage.predictor_sets / symbols
+			<< std::setw(8) << usage.users_sets / symbols
+			<< std::setw(8) << usage.time_table / symbols
+			<< std::setw(8) << (usage.predictions + usage.other) / symbols
+			<< std::setprecision(0) << std::setw(12) << peakRss() / KB
+			<< std::setw(12) << clock.time() / 1000.0 << std::endl;
+	}
+}
+
+/**
+* memory_bench                       - both storages over growing traces, the peak RSS is the one of the process so far
+* memory_bench linked|compact count  - one storage and one trace, so the peak RSS belongs to it alone
+*/
+int main(int argc, char** argv)
+{
+	std::cout << std::setw(9) << "storage" << std::setw(10) << "requests" << std::setw(10) << "symbols" << std::setw(8) << "rules"
+		<< std::setw(10) << "total,KB" << std::setw(10) << "B/symbol" << std::setw(9) << "symbols" << std::setw(8) << "rules"
+		<< std::setw(8) << "index" << std::setw(8) << "occur" << std::setw(8) << "preds" << std::setw(8) << "users"
+		<< std::setw(8) << "times" << std::setw(8) << "other" << std::setw(12) << "peak RSS,KB" << std::setw(12) << "insert,ms" << std::endl;
+
+	if (argc == 3) {
+		const std::string_view storage{ argv[1] };
+		if (storage != "linked" && storage != "compact") {
+			std::cerr << "Unknown storage: " << storage << std::endl;
+			return 1;
+		}
+		bench::run(storage == "linked" ? model::grammar_storage_t::LINKED : model::grammar_storage_t::COMPACT,
+			static_cast<size_t>(std::strtoull(argv[2], nullptr, 10)));
+		return 0;
+	}
+
+	for (auto storage : { model::grammar_storage_t::COMPACT, model::grammar_storage_t::LINKED }) {
+		for (size_t requests : { 10'000ULL, 50'000ULL, 200'000ULL }) {
+			bench::run(storage, requests);
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
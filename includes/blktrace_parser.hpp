@@ -6,6 +6,7 @@
 #include <vector>
 #include <functional>
 #include <optional>
+#include <limits>
 #include "model/blk_info.hpp"
 
 struct blk_io_trace;
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace pIOn
 {
@@ -24,6 +25,20 @@ namespace pIOn
 		bool delta{ false };
 		bool type_based{ false };
 		uint8_t type{ 0 }; // 0 - read, 1 - write
+		bool compact_grammar{ false };  // handle-indexed grammar storage instead of the linked one
+		bool evict_rules{ false };      // forget the oldest input at the grammar limit instead of the reset
+		std::string shard_by{ "none" }; // none, pid, cpu or lba - a prophet per stream instead of one
+		uint32_t shard_workers{ 0 };    // 0 - one per hardware thread
+		uint64_t memory_limit{ 0 };     // bytes per prophet, 0 - only max_grammar_size limits it
+		uint64_t memory_budget{ 0 };    // bytes shared by the sharded prophets by their hits, 0 - none
+		std::string engine{ "sequitur" }; // sequitur, markov or ppm - what learns the keys
+		uint32_t context_order{ 2 };    // keys in a context of the markov and ppm engines
+		uint32_t stride_streams{ 0 };   // sequential and strided streams answered ahead of the engine, 0 - none
+		std::string key{ "standart" };  // standart, delta, interned, sector or offset - packed, relative, dense ids, LBAs or sizes of the requests
+		std::vector<uint64_t> region_levels{};     // bytes of the regions predicted when the exact keys are not, finest first
+		uint64_t region_readahead{ 1ULL << 20 };  // bytes, bound of a region hint
+		bool factorized{ false };       // sizes learned apart from the LBAs
+		int64_t time_table_limit{ -1 }; // pairs of symbols timed at most, -1 - a few per symbol of max_grammar_size, 0 - no bound
 	};
 
 	[[nodiscard]] Config getConfig(std::string_view file_path);
@@ -0,0 +1,416 @@
+#pragma once
+/******************************************************************************
+ This file contains portions of code originating from C. Nevill-Manning's
+ Sequitur (http://www.sequitur.info/sequitur_simple.cc) under the terms and
+ conditions of the Apache 2.0 License, which can be found at
+ https://www.apache.org/licenses/LICENSE-2.0
+*******************************************************************************/
+
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <vector>
+#include <stack>
+#include <span>
+#include <array>
+#include <algorithm>
+#include "types.hpp"
+#include "utils/iterator_range.hpp"
+#include "utils/digram_table.hpp"
+#include "utils/flat_map.hpp"
+#include "utils/small_set.hpp"
+#include "stats/grammar_stats.hpp"
+#include "stats/memory_usage.hpp"
+#include "limit_policy.hpp"
+#include "grammar_snapshot.hpp"
+
+namespace pIOn::sequitur {
+
+	/**
+	* @brief Same grammar and predictors as Predictor, but symbols and rules live in
+	* contiguous arrays and refer to each other by 32-bit handles instead of pointers.
+	* The links that grammar maintenance walks on every insert (next/prev/owner/value)
+	* are kept apart from the predictor bookkeeping, so a grammar of 100k symbols needs
+	* about 2.4 MB of hot data.
+	*/
+	class CompactPredictor
+	{
+	public:
+		using handle_t = uint32_t;
+		static constexpr handle_t NIL = 0; // handle 0 is never allocated
+
+	private:
+		using handle_set_t = utils::SmallFlatSet<handle_t, 2>;
+
+		// Same bits as in a snapshot, links are saved as they are
+		enum link_flags_t : uint8_t
+		{
+			TERMINAL  = snapshot::TERMINAL,
+			PREDICTOR = snapshot::PREDICTOR,
+		};
+
+		// Hot part of a symbol, touched by every join/check/substitute
+		struct link_t
+		{
+			uint64_t sym{};        // terminal value or the handle of the rule
+			handle_t next{ NIL };
+			handle_t prev{ NIL };
+			handle_t owner{ NIL }; // rule in which this symbol appears
+			uint8_t flags{ TERMINAL };
+		};
+		static_assert(sizeof(link_t) == 24, "link_t must stay within 24 bytes!");
+
+		// Cold part of a symbol, touched only by the predictors update
+		struct predictor_state_t
+		{
+			handle_set_t predictors;
+			handle_set_t next_new_predictor;  // next set of new predictors
+			handle_set_t next_stay_predictor; // predictors that stay predictors
+			bool next_is_predictor{ false };  // next value for PREDICTOR flag
+			bool next_updated{ false };       // wether we already called compute_next_predictors
+			uint8_t next_return{};            // return value of the last call to compute_next_predictors
+		};
+
+		// Symbols with the same key are chained, so find_new_predictors visits only them
+		struct occurrence_t
+		{
+			handle_t next{ NIL };
+			handle_t prev{ NIL };
+		};
+
+		struct rule_t
+		{
+			handle_t guard{ NIL };
+			handle_t idx{};        // for printing only
+			uint32_t length{};     // symbols in the right-hand side
+			handle_set_t users;    // non-terminals that instantiate this rule
+			bool alive{ false };
+		};
+
+		// Digram keys of non-terminals are tagged, so they do not mix with the terminals
+		static constexpr uint64_t RULE_TAG = 1ULL << 63;
+
+		std::vector<link_t> links_;
+		std::vector<predictor_state_t> states_;
+		std::vector<occurrence_t> occurrences_;
+		std::vector<rule_t> rules_;
+		std::vector<handle_t> free_symbols_;
+		std::vector<handle_t> free_rules_;
+
+		handle_t axiom_{ NIL };
+		handle_t root_{ NIL };
+
+		utils::SmallFlatSet<handle_t, 8> predictions_;
+		utils::DigramTable<handle_t> index_;
+		utils::FlatMap<uint64_t, handle_t> occurrence_heads_; // key -> first symbol having it
+
+		std::vector<handle_t> print_rules_;
+		uint64_t print_idx_{};
+		size_t symbols_count_{}; // sum of rule_t::length
+		uint64_t version_{}; // For iterator validation and limits checks
+		size_t limit_{ ~0ULL }; // Grammar limit
+		limit_policy_t policy_{ limit_policy_t::RESET };
+		std::vector<handle_t> evicted_rules_; // rules that lost their last user during the eviction
+
+		// Upper bound of the index presizing, so a big or unbounded limit costs nothing up front,
+		// bigger grammars grow the index by its load factor
+		static constexpr size_t INDEX_PRESIZE_LIMIT = 1ULL << 12;
+
+		// Storage
+		void init();
+		handle_t allocate_symbol(uint64_t sym, handle_t owner);
+		handle_t allocate_nt(handle_t rule, handle_t owner);
+		handle_t allocate_rule();
+		void free_symbol(handle_t s);
+		void free_rule(handle_t r);
+
+		// Symbol properties
+		bool nt(handle_t s) const noexcept { return !(links_[s].flags & TERMINAL) && links_[s].sym != 0; }
+		bool term(handle_t s) const noexcept { return !nt(s); }
+		bool is_pred(handle_t s) const noexcept { return links_[s].flags & PREDICTOR; }
+		bool is_guard(handle_t s) const noexcept { return nt(s) && rules_[rule(s)].guard == s; }
+		handle_t next(handle_t s) const noexcept { return links_[s].next; }
+		handle_t prev(handle_t s) const noexcept { return links_[s].prev; }
+		handle_t owner(handle_t s) const noexcept { return links_[s].owner; }
+		handle_t rule(handle_t s) const noexcept { return static_cast<handle_t>(links_[s].sym); }
+		uint64_t key(handle_t s) const noexcept { return nt(s) ? (RULE_TAG | links_[s].sym) : links_[s].sym; }
+		uint64_t freq(handle_t s) const noexcept { return owner(s) ? rules_[owner(s)].users.size() : 0ULL; }
+		void set_pred(handle_t s, bool is_pred) noexcept;
+
+		// Rule properties
+		handle_t first(handle_t r) const noexcept { return next(rules_[r].guard); }
+		handle_t last(handle_t r) const noexcept { return prev(rules_[r].guard); }
+		size_t length(handle_t r) const noexcept { return rules_[r].length ? rules_[r].length : 1; }
+		void resize(handle_t r, int64_t delta) noexcept;
+
+		// Perform operations with the index
+		handle_t find_digram(handle_t s) const noexcept;
+		void delete_digram(handle_t s) noexcept;
+		void set_digram(handle_t s);
+
+		// Perform operations with the lists of occurrences
+		void link_occurrence(handle_t s);
+		void unlink_occurrence(handle_t s) noexcept;
+
+		// Grammar maintenance
+		void join(handle_t left, handle_t right);
+		void insert_after(handle_t s, handle_t y);
+		handle_t release(handle_t s);
+		void expand(handle_t s);
+		void substitute(handle_t s, handle_t r);
+		void match(handle_t ss, handle_t m);
+		bool check(handle_t s);
+
+		// Predictors maintenance
+		void become_predictor_down_left(handle_t s);
+		void become_predictor_down_right(handle_t s);
+		void become_predictor_up(handle_t user, handle_t child);
+		void process_matching(handle_t s, handle_t matching);
+		uint8_t compute_next_predictors(handle_t s, handle_t matching);
+		void update_predictors(handle_t s);
+		void find_potential_predictors(handle_t occurrence, handle_t matching);
+		void find_new_predictors(handle_t s);
+		void drop_predictors(handle_t s);
+		void clear_predictors(handle_t s);
+		void append(uint64_t x, bool predict);
+
+		void add_prediction(handle_t s) { predictions_.insert(s); }
+		void remove_prediction(handle_t s) noexcept { predictions_.erase(s); }
+
+		bool checkLimits();
+		void evict_oldest();
+		void forget(handle_t s);
+		void print_rule(std::ostream& stream, handle_t r);
+
+	public:
+		CompactPredictor();
+		CompactPredictor(const CompactPredictor&) = delete;
+		CompactPredictor& operator=(const CompactPredictor&) = delete;
+		CompactPredictor(CompactPredictor&&) noexcept = default;
+		CompactPredictor& operator=(CompactPredictor&&) noexcept = default;
+		~CompactPredictor() noexcept = default;
+
+		/**
+		* @brief read-only view of a predicted symbol, mimics the Symbols* API
+		* that predict_range() of Predictor yields
+		*/
+		class symbol_view
+		{
+		public:
+			symbol_view(const CompactPredictor* p, handle_t h) noexcept : parent_(p), handle_(h) {}
+
+			bool term() const noexcept { return parent_->term(handle_); }
+			bool nt() const noexcept { return parent_->nt(handle_); }
+			uint64_t get_symbol() const noexcept { return parent_->links_[handle_].sym; }
+			uint64_t freq() const noexcept { return parent_->freq(handle_); }
+			handle_t handle() const noexcept { return handle_; }
+			const symbol_view* operator->() const noexcept { return this; }
+
+		private:
+			const CompactPredictor* parent_;
+			handle_t handle_;
+		};
+
+		class prediction_iterator
+		{
+		public:
+			using difference_type = std::ptrdiff_t;
+			using value_type = symbol_view;
+			using pointer = void;
+			using reference = symbol_view;
+			using iterator_category = std::forward_iterator_tag;
+
+			prediction_iterator() = default;
+			prediction_iterator(const CompactPredictor* p, const handle_t* pos) noexcept : parent_(p), pos_(pos) {}
+
+			symbol_view operator*() const noexcept { return symbol_view{ parent_, *pos_ }; }
+			prediction_iterator& operator++() noexcept { ++pos_; return *this; }
+			prediction_iterator operator++(int) noexcept { auto it = *this; ++pos_; return it; }
+			bool operator==(const prediction_iterator& other) const noexcept { return pos_ == other.pos_; }
+			bool operator!=(const prediction_iterator& other) const noexcept { return pos_ != other.pos_; }
+
+		private:
+			const CompactPredictor* parent_{ nullptr };
+			const handle_t* pos_{ nullptr };
+		};
+
+		using iterator_range = IteratorRange<prediction_iterator>;
+
+		// See Predictor::cursor
+		class cursor
+		{
+		public:
+			static constexpr size_t MAX_DEPTH = 48;
+
+			cursor() = default;
+
+			uint64_t operator*() const; // current terminal, 0 at the end
+			cursor& operator++();
+			size_t advance(size_t steps); // returns the number of steps made
+
+			// Copies the current terminal and the following ones, the cursor moves past them
+			size_t read(std::span<uint64_t> out);
+
+			bool done() const noexcept { return depth_ == 0; }
+			bool truncated() const noexcept { return truncated_; }
+			uint64_t freq() const noexcept { return freq_; } // of the predicted symbol the cursor started from
+			uint64_t support() const noexcept { return support_; } // sum of freq() along the starting path
+
+		private:
+			friend class CompactPredictor;
+			void push(handle_t s) noexcept;
+			void check() const;
+
+			class invalid_cursor : public std::exception
+			{
+			public:
+				const char* what() const noexcept override
+				{
+					return "Invalid cursor";
+				}
+			};
+
+			std::array<handle_t, MAX_DEPTH> path_{};
+			const CompactPredictor* parent_{ nullptr };
+			uint64_t version_{};
+			uint64_t freq_{};
+			uint64_t support_{};
+			uint32_t depth_{ 0 };
+			bool truncated_{ false };
+		};
+
+		class iterator
+		{
+		private:
+			friend class CompactPredictor;
+			std::stack<handle_t> stack;
+			const CompactPredictor* parent;
+			uint64_t version;
+			iterator(const CompactPredictor* p, handle_t start = NIL);
+			iterator(const CompactPredictor* p, std::stack<handle_t>& s, handle_t start = NIL);
+			iterator(const CompactPredictor* p, const cursor& c);
+
+			class invalid_iterator : public std::exception
+			{
+			public:
+				const char* what() const noexcept override
+				{
+					return "Invalid iterator";
+				}
+			};
+
+		public:
+			using difference_type = std::ptrdiff_t;
+			using value_type = uint64_t;
+			using iterator_category = std::forward_iterator_tag;
+
+			iterator& operator++();
+			iterator operator++(int);
+			uint64_t operator*() const;
+			bool operator==(const iterator&);
+			bool operator!=(const iterator&);
+		};
+
+		iterator begin() const {
+			return iterator(this, first(axiom_));
+		}
+
+		iterator end() const {
+			return iterator(this);
+		}
+
+		bool insert(uint64_t x);
+		bool insert_batch(std::span<const uint64_t> xs, bool predict_last_only = false); // see Predictor::insert_batch
+		std::list<uint64_t> predict_next() const;
+		std::list<iterator> predict_all() const;
+		iterator_range predict_range() const;
+
+		// See Predictor::for_each_cursor
+		template<typename F>
+		void for_each_cursor(F&& func) const;
+
+		size_t size() const;
+		grammar_stats_t stats() const;
+
+		// Walks the rules to find the spilled sets, O(grammar size)
+		memory_usage_t memory_usage() const;
+
+		/**
+		* @brief bytes of the live symbols, rules and entries of the grammar in O(1). The spilled sets
+		* are not counted, the containers may hold more while they grow or after the grammar shrinks.
+		*/
+		size_t footprint() const noexcept;
+
+		/**
+		* @brief brings the grammar below limit symbols the way the limit policy does it
+		*
+		* @return false if the grammar has been reset
+		*/
+		bool trim(size_t limit);
+		void setLimits(size_t limit);
+		void setLimitPolicy(limit_policy_t policy) noexcept;
+
+		// Grammar and predictors in the layout of grammar_snapshot.hpp, limits are not saved
+		void save(utils::SnapshotWriter& writer) const;
+		void load(utils::SnapshotReader& reader);
+
+		friend std::ostream& operator<<(std::ostream& stream, CompactPredictor& o);
+	};
+
+	std::ostream& operator<<(std::ostream& stream, CompactPredictor& o);
+
+	template<typename F>
+	void CompactPredictor::for_each_cursor(F&& func) const
+	{
+		cursor c;
+		c.parent_ = this;
+		c.version_ = version_;
+		uint32_t depth = 0;
+		std::vector<handle_t> outer; // the outermost part of a path deeper than the cursor holds
+
+		handle_t s = first(rule(root_));
+		LOOP
+		{
+			if (is_guard(s)) {
+				if (depth == 0) {
+					return;
+				}
+				s = next(c.path_[--depth]);
+				if (!outer.empty()) {
+					std::move_backward(c.path_.begin(), c.path_.begin() + depth, c.path_.begin() + depth + 1);
+					c.path_[0] = outer.back();
+					outer.pop_back();
+					++depth;
+				}
+				continue;
+			}
+
+			if (is_pred(s) && nt(s)) {
+				// the terminal takes the last place of the path, deeper paths keep their outermost symbols aside
+				if (depth + 1 == cursor::MAX_DEPTH) {
+					outer.push_back(c.path_[0]);
+					std::move(c.path_.begin() + 1, c.path_.begin() + depth, c.path_.begin());
+					--depth;
+				}
+				c.path_[depth++] = s;
+				s = first(rule(s));
+				continue;
+			}
+			if (is_pred(s) && term(s)) {
+				c.path_[depth] = s;
+				c.depth_ = depth + 1;
+				c.freq_ = freq(s);
+				c.truncated_ = !outer.empty();
+				c.support_ = 0;
+				for (handle_t o : outer) {
+					c.support_ += freq(o);
+				}
+				for (uint32_t i = 0; i < c.depth_; ++i) {
+					c.support_ += freq(c.path_[i]);
+				}
+				func(cursor{ c });
+			}
+			s = next(s);
+		}
+	}
+}
\ No newline at end of file
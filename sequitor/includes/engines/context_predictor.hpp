@@ -0,0 +1,168 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <span>
+#include <exception>
+
+#include "engine.hpp"
+#include "utils/flat_map.hpp"
+#include "utils/iterator_range.hpp"
+#include "utils/snapshot.hpp"
+
+namespace pIOn::engines
+{
+	// How ContextPredictor uses the contexts
+	enum class context_mode_t : uint8_t
+	{
+		MARKOV, // the last order keys only
+		PPM     // the longest context that has been seen, shorter ones take the escaped probability
+	};
+
+	/**
+	* @brief Predicts the next key from the keys before it. Every context (a hash of the last keys)
+	* keeps its few most frequent successors in a flat table, so an insert is a hash and a probe per
+	* context and needs no memory once the table has grown. Unlike a grammar, it cannot see
+	* repetitions longer than its order. The limits count contexts, at the limit the RESET policy
+	* clears the table and EVICT halves every count, so the contexts seen rarely leave.
+	*/
+	class ContextPredictor
+	{
+	public:
+		static constexpr size_t MAX_ORDER = 8;
+		static constexpr size_t WAYS = 4;            // successors kept per context
+		static constexpr uint64_t PPM_SCALE = 1000;  // freq() of a PPM prediction is its probability in thousandths
+
+		explicit ContextPredictor(size_t order = 2, context_mode_t mode = context_mode_t::MARKOV);
+		ContextPredictor(const ContextPredictor&) = delete;
+		ContextPredictor& operator=(const ContextPredictor&) = delete;
+
+		class prediction_t
+		{
+		public:
+			bool term() const noexcept { return true; }
+			uint64_t get_symbol() const noexcept { return sym_; }
+			uint64_t freq() const noexcept { return freq_; }
+			const prediction_t* operator->() const noexcept { return this; }
+
+		private:
+			friend class ContextPredictor;
+			uint64_t sym_{};
+			uint64_t freq_{};
+			double probability_{};
+		};
+
+		using iterator_range = IteratorRange<std::vector<prediction_t>::const_iterator>;
+
+		// See Predictor::cursor, a continuation goes on with the most frequent successor of its context
+		class cursor
+		{
+		public:
+			cursor() = default;
+
+			uint64_t operator*() const; // current key, 0 at the end
+			cursor& operator++();
+			size_t advance(size_t steps); // returns the number of steps made
+			size_t read(std::span<uint64_t> out);
+
+			bool done() const noexcept { return sym_ == 0; }
+			uint64_t freq() const noexcept { return freq_; }       // of the predicted key the cursor started from
+			uint64_t support() const noexcept { return freq_; }    // the context is the whole path
+
+		private:
+			friend class ContextPredictor;
+			void check() const;
+
+			class invalid_cursor : public std::exception
+			{
+			public:
+				const char* what() const noexcept override
+				{
+					return "Cursor is used after the predictor has changed!";
+				}
+			};
+
+			const ContextPredictor* parent_{ nullptr };
+			uint64_t version_{};
+			std::array<uint64_t, MAX_ORDER> history_{};
+			size_t history_size_{};
+			uint64_t sym_{};
+			uint64_t freq_{};
+		};
+
+		bool insert(uint64_t x);
+
+		// Same as insert() for every key, the predictions are made for the last one only if predict_last_only
+		bool insert_batch(std::span<const uint64_t> xs, bool predict_last_only = false);
+		iterator_range predict_range() const;
+
+		template<typename F>
+		void for_each_cursor(F&& func) const;
+
+		size_t size() const noexcept;
+		sequitur::grammar_stats_t stats() const noexcept;
+		sequitur::memory_usage_t memory_usage() const noexcept;
+		size_t footprint() const noexcept;
+		bool trim(size_t limit);
+		void setLimits(size_t limit);
+		void setLimitPolicy(sequitur::limit_policy_t policy) noexcept;
+
+		// Snapshots hold grammars, both throw std::runtime_error
+		void save(utils::SnapshotWriter& writer) const;
+		void load(utils::SnapshotReader& reader);
+
+	private:
+		struct successor_t
+		{
+			uint64_t sym{};
+			uint64_t count{};
+		};
+
+		// Successors sorted by count, the least frequent one is replaced by a new one
+		struct context_t
+		{
+			std::array<successor_t, WAYS> ways{};
+			uint64_t total{};
+		};
+
+		// Upper bound of the table presizing, bigger tables grow on demand
+		static constexpr size_t PRESIZE_LIMIT = 1ULL << 16;
+
+		static uint64_t contextOf(const std::array<uint64_t, MAX_ORDER>& history, size_t order) noexcept;
+		static void push(std::array<uint64_t, MAX_ORDER>& history, size_t& history_size, uint64_t x) noexcept;
+		void append(uint64_t x);
+		void learn(uint64_t context, uint64_t x);
+		void age();
+		void predict();
+
+		// Successor a continuation takes after the given history, nullptr if none
+		const successor_t* best(const std::array<uint64_t, MAX_ORDER>& history, size_t history_size) const noexcept;
+
+		utils::FlatMap<uint64_t, context_t> table_;
+		std::array<uint64_t, MAX_ORDER> history_{}; // the latest key goes first
+		size_t history_size_{};
+		std::vector<prediction_t> predictions_;
+		std::vector<uint64_t> scratch_;              // contexts to erase during the aging
+		size_t order_;
+		context_mode_t mode_;
+		size_t successors_{};                        // ways in use over all contexts
+		uint64_t version_{};
+		size_t limit_{ ~0ULL };
+		sequitur::limit_policy_t policy_{ sequitur::limit_policy_t::RESET };
+	};
+
+	template<typename F>
+	void ContextPredictor::for_each_cursor(F&& func) const
+	{
+		cursor c;
+		c.parent_ = this;
+		c.version_ = version_;
+		c.history_ = history_;
+		c.history_size_ = history_size_;
+
+		for (const prediction_t& prediction : predictions_) {
+			c.sym_ = prediction.sym_;
+			c.freq_ = prediction.freq_;
+			func(cursor{ c });
+		}
+	}
+}
\ No newline at end of file
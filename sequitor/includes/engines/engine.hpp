@@ -0,0 +1,41 @@
+#pragma once
+#include <concepts>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+#include "limit_policy.hpp"
+#include "stats/grammar_stats.hpp"
+#include "stats/memory_usage.hpp"
+
+namespace pIOn::engines
+{
+	// What learns the stream of keys behind IOProphet
+	enum class engine_t : uint8_t
+	{
+		SEQUITUR, // grammar of the whole input, see prophet_cfg_t::storage_ for its layout
+		MARKOV,   // successors of the last k keys, engines::ContextPredictor
+		PPM       // successors of the last 1..k keys blended with escapes, engines::ContextPredictor
+	};
+
+	/**
+	* @brief Operations IOProphet needs from an engine. Predictions are given as a range of
+	* symbol views (term(), get_symbol(), freq()) and as cursors that walk on along a continuation.
+	* Sizes and limits are counted in the units of the engine: symbols of a grammar, contexts of a table.
+	*/
+	template<typename E>
+	concept engine = requires(E& e, const E& ce, uint64_t x, std::span<const uint64_t> xs, size_t limit, sequitur::limit_policy_t policy)
+	{
+		{ e.insert(x) } -> std::same_as<bool>;
+		{ e.insert_batch(xs, true) } -> std::same_as<bool>;
+		{ ce.predict_range().size() } -> std::convertible_to<size_t>;
+		ce.for_each_cursor([](const auto& cursor) { static_cast<void>(*cursor); });
+		{ ce.size() } -> std::convertible_to<size_t>;
+		{ ce.stats() } -> std::same_as<sequitur::grammar_stats_t>;
+		{ ce.memory_usage() } -> std::same_as<sequitur::memory_usage_t>;
+		{ ce.footprint() } -> std::convertible_to<size_t>;
+		{ e.trim(limit) } -> std::same_as<bool>;
+		e.setLimits(limit);
+		e.setLimitPolicy(policy);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include <span>
+#include <cstdint>
+#include "utils/snapshot.hpp"
+
+// On-disk layout of a grammar, shared by Predictor and CompactPredictor, so a snapshot
+// made by one of them can be loaded by the other. Symbols and rules refer to each
+// other by indices (handle 0 is NIL), hence a snapshot does not depend on the addresses.
+namespace pIOn::sequitur::snapshot
+{
+	enum symbol_flags_t : uint8_t
+	{
+		TERMINAL  = 1 << 0,
+		PREDICTOR = 1 << 1,
+	};
+
+	struct symbol_t
+	{
+		uint64_t sym{};     // terminal value or the handle of the rule
+		uint32_t next{};
+		uint32_t prev{};
+		uint32_t owner{};   // rule in which the symbol appears
+		uint8_t flags{};
+		uint8_t reserved[3]{};
+	};
+	static_assert(sizeof(symbol_t) == 24, "symbol_t has to be padding-free!");
+
+	struct rule_t
+	{
+		uint32_t guard{};   // NIL for an unused slot
+		uint32_t length{};
+	};
+
+	// A symbol and one of the symbols that it holds as a predictor
+	struct predictor_t
+	{
+		uint32_t holder{};
+		uint32_t child{};
+	};
+
+	// Whole grammar, the arrays point either to the memory of the writer or into the file
+	struct grammar_t
+	{
+		uint32_t axiom{};
+		uint32_t root{};                          // non-terminal of the axiom, the root of the predictors
+		std::span<const symbol_t> symbols;        // [0] is NIL
+		std::span<const rule_t> rules;            // [0] is NIL
+		std::span<const uint32_t> free_symbols;   // unused slots of symbols, in the order of reuse
+		std::span<const uint32_t> free_rules;     // unused slots of rules, in the order of reuse
+		std::span<const predictor_t> predictors;
+		std::span<const uint32_t> predictions;
+		std::span<const uint32_t> digrams;        // symbols that start a digram of the index
+	};
+
+	void write(utils::SnapshotWriter& writer, const grammar_t& grammar);
+
+	/**
+	* @brief reads a grammar and checks that it is consistent: handles are in range, the rules
+	* are well-formed doubly-linked rings and the predictors refer to symbols of the rules.
+	* Throws std::runtime_error otherwise, so loaders can trust the result.
+	*/
+	grammar_t read(utils::SnapshotReader& reader);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "key_holder.hpp"
+
+namespace pIOn::keys
+{
+	/// <summary>
+	/// Key, that map [OP, SIZE, LBA - base LBA] <-> sym. A pattern moved to other LBAs gives the same keys.
+	/// </summary>
+	class DeltaKey
+	{
+	public:
+		// [DELTA : 38 | SIZE : 24 | OP : 2], op is 1 or 2, so no key is 0
+		static constexpr uint64_t to_key(const blk_info_t& info, uint64_t base) noexcept
+		{
+			// two's complement delta in sectors, enough for +-64 TB
+			const uint64_t delta = (info.lba() - base) & ((1ULL << DELTA_BITS) - 1);
+			const uint64_t size = (info.size() / SECTOR_SIZE) & ((1ULL << SIZE_BITS) - 1);
+			const uint64_t op = info.type() == OPERATION::READ ? 1 : 2;
+
+			return delta << (SIZE_BITS + OP_BITS) | size << OP_BITS | op;
+		}
+
+		// every key of the batch is relative to the request before it, the first one to the base
+		static constexpr void to_keys(std::span<const blk_info_t> infos, uint64_t* keys, uint64_t base) noexcept
+		{
+			for (const blk_info_t& info : infos) {
+				*keys++ = to_key(info, base);
+				base = info.lba();
+			}
+		}
+
+		static constexpr BlkInfoBuilder from_key(uint64_t sym, uint64_t base) noexcept
+		{
+			// the arithmetic shift extends the sign of the delta
+			const int64_t delta = static_cast<int64_t>(sym) >> (SIZE_BITS + OP_BITS);
+			const uint64_t size = sym >> OP_BITS & ((1ULL << SIZE_BITS) - 1);
+
+			BlkInfoBuilder builder;
+			builder.setSector(base + static_cast<uint64_t>(delta)).setSize(size * SECTOR_SIZE).setOp((sym & 3) == 1 ? 0 : 1);
+			return builder;
+		}
+
+	private:
+		static constexpr uint64_t OP_BITS = 2;
+		static constexpr uint64_t SIZE_BITS = 24;
+		static constexpr uint64_t DELTA_BITS = 64 - OP_BITS - SIZE_BITS;
+		static constexpr uint64_t SECTOR_SIZE = 512;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <limits>
+
+#include "key_holder.hpp"
+#include "model/blk_info.hpp"
+#include "utils/flat_map.hpp"
+
+namespace pIOn::keys
+{
+	/// <summary>
+	/// Key, that map [OP, SIZE, LBA] <-> dense id from 1. Unlike StandartKey, every field is kept whole.
+	/// The ids are still 64-bit symbols of the grammar, it does not narrow its handles or digram keys for them.
+	/// </summary>
+	class InternedKey
+	{
+	public:
+		static constexpr size_t MAX_IDS = std::numeric_limits<uint32_t>::max();
+
+		explicit InternedKey(size_t capacity = MAX_IDS) noexcept;
+
+		// a request seen for the first time gets the next id, so the table grows with the distinct requests.
+		// Once the ids run out the table is forgotten and they are given anew, the caller drops the old ones, see room()
+		uint64_t to_key(const blk_info_t& info, uint64_t = 0);
+		void to_keys(std::span<const blk_info_t> infos, uint64_t* keys, uint64_t = 0);
+		// a symbol that is not interned gives an empty builder, with OPERATION::NONE
+		BlkInfoBuilder from_key(uint64_t sym, uint64_t = 0) const noexcept;
+
+		void clear() noexcept;
+		size_t bytes() const noexcept;
+		size_t size() const noexcept;
+		size_t room() const noexcept; // new requests that get an id before the table is forgotten
+
+	private:
+		struct request_t
+		{
+			uint64_t lba{};
+			uint64_t size{};
+			OPERATION op{ OPERATION::NONE };
+		};
+
+		// [LBA, SIZE << 2 | OP] -> id
+		utils::FlatMap<std::pair<uint64_t, uint64_t>, uint32_t> ids_;
+		std::vector<request_t> requests_; // by id - 1
+		size_t capacity_;
+	};
+}
\ No newline at end of file
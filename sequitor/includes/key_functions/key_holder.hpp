@@ -1,20 +1,26 @@
 #pragma once
+#include <concepts>
 #include <cstdint>
+#include <cstddef>
+#include <span>
 
-namespace pIOn
-{
-	class blk_info_t;
-	class BlkInfoBuilder;
-}
+#include "model/blk_info.hpp"
 
 namespace pIOn::keys
 {
-	class KeyHolder
+	/**
+	* @brief Policy that maps a request to a symbol and back. Both ways are pure: a key is made from the request
+	* and a base, the LBA of the request learned before it, which only the relative keys (DeltaKey) use.
+	* from_key() returns a builder of its own, so the predictions may be decoded from any number of threads.
+	* A policy that keeps its keys in a table (InternedKey) may change in to_key() and may have
+	* clear() and bytes(), IOProphet calls them once the grammar holds none of its keys, and room(),
+	* IOProphet forgets the grammar before the table runs out of keys.
+	*/
+	template<typename K>
+	concept key_holder = requires(K& key, const K& ckey, const blk_info_t& info, std::span<const blk_info_t> infos, uint64_t* keys, uint64_t sym, uint64_t base)
 	{
-	public:
-		virtual ~KeyHolder() = default;
-
-		virtual uint64_t to_key(const blk_info_t& info) const noexcept = 0;
-		virtual BlkInfoBuilder& from_key(uint64_t sym) noexcept = 0;
+		{ key.to_key(info, base) } -> std::same_as<uint64_t>;
+		key.to_keys(infos, keys, base); // keys must have room for infos.size() keys
+		{ ckey.from_key(sym, base) } -> std::same_as<BlkInfoBuilder>;
 	};
 }
\ No newline at end of file
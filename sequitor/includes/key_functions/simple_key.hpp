@@ -1,17 +1,42 @@
 #pragma once
 #include "key_holder.hpp"
-#include "model/blk_info.hpp"
 
 namespace pIOn::keys
 {
+	// Key of a single field of a request, the LBA or the size, the other fields are lost
 	template<bool IsSector>
-	class SimpleKey : public KeyHolder
+	class SimpleKey
 	{
 	public:
-		uint64_t to_key(const blk_info_t& info) const noexcept final;
-		BlkInfoBuilder& from_key(uint64_t sym) noexcept final;
-	private:
-		BlkInfoBuilder builder_;
+		static constexpr uint64_t to_key(const blk_info_t& info, uint64_t = 0) noexcept
+		{
+			if constexpr (IsSector) {
+				return info.lba();
+			}
+			else {
+				return info.size();
+			}
+		}
+
+		static constexpr void to_keys(std::span<const blk_info_t> infos, uint64_t* keys, uint64_t = 0) noexcept
+		{
+			for (const blk_info_t& info : infos) {
+				*keys++ = to_key(info);
+			}
+		}
+
+		static constexpr BlkInfoBuilder from_key(uint64_t sym, uint64_t = 0) noexcept
+		{
+			BlkInfoBuilder builder;
+			if constexpr (IsSector) {
+				builder.setSector(sym).setSize(0).setOp(0);
+			}
+			else {
+				builder.setSector(0).setSize(sym).setOp(0);
+			}
+
+			return builder;
+		}
 	};
 
 	using SectorKey = SimpleKey<true>;
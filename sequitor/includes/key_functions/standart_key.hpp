@@ -1,19 +1,44 @@
 #pragma once
+#include <cassert>
+
 #include "key_holder.hpp"
-#include "model/blk_info.hpp"
 
 namespace pIOn::keys
 {
 	/// <summary>
 	/// Key, that map [OP, SIZE, LBA] <-> sym
 	/// </summary>
-	class StandartKey : public KeyHolder
+	class StandartKey
 	{
 	public:
-		uint64_t to_key(const blk_info_t& info) const noexcept final;
-		BlkInfoBuilder& from_key(uint64_t sym) noexcept final;
+		// [OFFSET / 8 : 31 | SIZE / 8 : 31 | OP : 2]
+		static constexpr uint64_t to_key(const blk_info_t& info, uint64_t = 0) noexcept
+		{
+			assert(info.type() != OPERATION::NONE && "op cannot be NONE");
+			const uint64_t op = info.type() == OPERATION::READ ? 0 : 1;
+			return op | (info.size() / WEIGHT & FIELD_MASK) << OP_BITS | (info.lba() / WEIGHT & FIELD_MASK) << (OP_BITS + FIELD_BITS);
+		}
+
+		static constexpr void to_keys(std::span<const blk_info_t> infos, uint64_t* keys, uint64_t = 0) noexcept
+		{
+			for (const blk_info_t& info : infos) {
+				*keys++ = to_key(info);
+			}
+		}
+
+		static constexpr BlkInfoBuilder from_key(uint64_t sym, uint64_t = 0) noexcept
+		{
+			BlkInfoBuilder builder;
+			builder.setSector((sym >> (OP_BITS + FIELD_BITS)) * WEIGHT)
+				.setSize((sym >> OP_BITS & FIELD_MASK) * WEIGHT)
+				.setOp(static_cast<uint8_t>(sym & ((1ULL << OP_BITS) - 1)));
+			return builder;
+		}
 
 	private:
-		BlkInfoBuilder builder_;
+		static constexpr uint64_t WEIGHT = 8;
+		static constexpr uint64_t OP_BITS = 2;
+		static constexpr uint64_t FIELD_BITS = 31;
+		static constexpr uint64_t FIELD_MASK = (1ULL << FIELD_BITS) - 1;
 	};
-}
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+namespace pIOn::sequitur
+{
+	// What the grammar does once its size reaches the limit
+	enum class limit_policy_t : uint8_t
+	{
+		RESET, // throw the whole grammar away and start from scratch
+		EVICT  // forget the oldest input symbol by symbol, rules that lose their users go with it
+	};
+}
\ No newline at end of file
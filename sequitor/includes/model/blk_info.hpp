@@ -14,42 +14,60 @@ namespace pIOn
 	class blk_info_t final
 	{
 	public:
-		blk_info_t() = default;
+		constexpr blk_info_t() = default;
 
-		[[nodiscard]] uint64_t lba() const noexcept
+		[[nodiscard]] constexpr uint64_t lba() const noexcept
 		{
 			return lba_;
 		}
 
-		[[nodiscard]] uint64_t size() const noexcept
+		[[nodiscard]] constexpr uint64_t size() const noexcept
 		{
 			return bytes_;
 		}
 
-		[[nodiscard]] double time() const noexcept
+		// Time since the previous request of the trace, as BLKParser gives it, 0 for the first one.
+		// A prediction is timed from the last inserted request instead
+		[[nodiscard]] constexpr double time() const noexcept
 		{
 			return time_;
 		}
 
-		[[nodiscard]] OPERATION type() const noexcept
+		[[nodiscard]] constexpr OPERATION type() const noexcept
 		{
 			return static_cast<OPERATION>(op_);
 		}
 
+		// Process that issued the request
+		[[nodiscard]] constexpr uint32_t pid() const noexcept
+		{
+			return pid_;
+		}
+
+		// CPU the request was traced on
+		[[nodiscard]] constexpr uint32_t cpu() const noexcept
+		{
+			return cpu_;
+		}
+
 	private:
 		friend class BlkInfoBuilder;
 
-		explicit blk_info_t(uint64_t lba, uint64_t bytes, double time, OPERATION op)
+		explicit constexpr blk_info_t(uint64_t lba, uint64_t bytes, double time, OPERATION op, uint32_t pid, uint32_t cpu)
 			: lba_(lba)
 			, bytes_(bytes)
 			, time_(time)
 			, op_(op)
+			, pid_(pid)
+			, cpu_(cpu)
 		{}
 
 		uint64_t lba_{ 0 };
 		uint64_t bytes_{ 0 };
 		double time_{ 0.0 };
 		OPERATION op_{ 127 };
+		uint32_t pid_{ 0 };
+		uint32_t cpu_{ 0 };
 	};
 
 	bool operator==(const blk_info_t& lhs, const blk_info_t& rhs);
@@ -59,25 +77,25 @@ namespace pIOn
 	class BlkInfoBuilder
 	{
 	public:
-		BlkInfoBuilder& setSector(uint64_t sector) noexcept
+		constexpr BlkInfoBuilder& setSector(uint64_t sector) noexcept
 		{
 			lba_ = sector;
 			return *this;
 		}
 
-		BlkInfoBuilder& setSize(uint64_t size) noexcept
+		constexpr BlkInfoBuilder& setSize(uint64_t size) noexcept
 		{
 			bytes_ = size;
 			return *this;
 		}
 
-		BlkInfoBuilder& setTime(double time) noexcept
+		constexpr BlkInfoBuilder& setTime(double time) noexcept
 		{
 			time_ = time;
 			return *this;
 		}
 
-		BlkInfoBuilder& setOp(uint8_t op) noexcept
+		constexpr BlkInfoBuilder& setOp(uint8_t op) noexcept
 		{
 			switch (op)
 			{
@@ -94,9 +112,21 @@ namespace pIOn
 			return *this;
 		}
 
-		blk_info_t build() const noexcept
+		constexpr BlkInfoBuilder& setPid(uint32_t pid) noexcept
+		{
+			pid_ = pid;
+			return *this;
+		}
+
+		constexpr BlkInfoBuilder& setCpu(uint32_t cpu) noexcept
+		{
+			cpu_ = cpu;
+			return *this;
+		}
+
+		constexpr blk_info_t build() const noexcept
 		{
-			return blk_info_t{ lba_, bytes_, time_, op_ };
+			return blk_info_t{ lba_, bytes_, time_, op_, pid_, cpu_ };
 		}
 
 	private:
@@ -104,5 +134,7 @@ namespace pIOn
 		uint64_t bytes_{ 0 };
 		double time_{ 0 };
 		OPERATION op_{ OPERATION::NONE };
+		uint32_t pid_{ 0 };
+		uint32_t cpu_{ 0 };
 	};
 }
\ No newline at end of file
@@ -1,25 +1,112 @@
 #pragma once
 #include <vector>
 #include <utility>
+#include <variant>
+#include <string_view>
+#include <span>
+#include <limits>
 
 #include "types.hpp"
 #include "blk_info.hpp"
 #include "predictor.hpp"
+#include "compact_predictor.hpp"
+#include "stride_detector.hpp"
+#include "engines/context_predictor.hpp"
 #include "utils/pair_map_adapter.hpp"
-#include "stats/weighted_stats.hpp"
-#include "key_functions/key_holder.hpp"
+#include "utils/published.hpp"
+#include "utils/flat_map.hpp"
+#include "stats/sketched_stats.hpp"
+#include "key_functions/standart_key.hpp"
+#include "key_functions/delta_key.hpp"
+#include "key_functions/interned_key.hpp"
+#include "key_functions/simple_key.hpp"
 
 namespace pIOn::model
 {
+	// How the grammar is kept in memory, both build the same grammar
+	enum class grammar_storage_t : uint8_t
+	{
+		LINKED,  // pointer-linked symbols, sequitur::Predictor
+		COMPACT  // handle-indexed arrays, sequitur::CompactPredictor
+	};
+
+	// How a request becomes a symbol
+	enum class key_function_t : uint8_t
+	{
+		STANDART, // absolute LBA, keys::StandartKey
+		DELTA,    // LBA relative to the previous learned request, keys::DeltaKey
+		INTERNED, // dense ids of whole requests, keys::InternedKey
+		SECTOR,   // LBA only, keys::SectorKey
+		OFFSET    // size only, keys::OffsetKey
+	};
+
 	struct prophet_cfg_t {
-		size_t grammar_limits_{ 5000 };
+		// The default of time_table_limit_, a few pairs per symbol of grammar_limits_
+		static constexpr size_t TIME_TABLE_DERIVED = std::numeric_limits<size_t>::max();
+
+		size_t grammar_limits_{ 5000 };                           // symbols of a grammar or contexts of a table
+		engines::engine_t engine_{ engines::engine_t::SEQUITUR };
+		grammar_storage_t storage_{ grammar_storage_t::LINKED };
+		key_function_t key_{ key_function_t::STANDART };
+		size_t context_order_{ 2 };                               // keys in a context of the MARKOV and PPM engines
+		sequitur::limit_policy_t limit_policy_{ sequitur::limit_policy_t::RESET };
+		bool publish_predictions_{ false }; // see IOProphet::getPublishedPredictions
+		size_t memory_limit_{ 0 };          // bytes, see IOProphet::setMemoryLimit
+		size_t stride_streams_{ 0 };        // streams followed ahead of the grammar, 0 turns it off, see StrideDetector
+		std::vector<uint64_t> region_levels_{};     // bytes of the LBA regions of the coarser grammars, finest first, they share grammar_limits_
+		uint64_t region_readahead_{ 1ULL << 20 };   // bytes, bound of a region hint
+		bool factorized_{ false };                  // sizes are learned apart from the LBAs, see IOProphet
+		size_t time_table_limit_{ TIME_TABLE_DERIVED }; // pairs of symbols timed at most, 0 - no bound, see PairMapAdapter
 	};
 
+	// Counted over the whole life of a prophet, resets of the grammar do not clear them
+	struct prediction_stats_t {
+		uint64_t requests_{ 0 }; // requests checked against the predictions made before them
+		uint64_t hits_{ 0 };     // requests that were among those predictions, with a predicted size if factorized
+		uint64_t region_hits_{ 0 }; // requests in a region hint of predict(), counted by insert() only
+	};
+
+	// Quantiles of the time from the last inserted request to a predicted one, all 0 if it is not timed
+	struct arrival_t {
+		double p50_{ 0.0 };
+		double p90_{ 0.0 };
+		double p99_{ 0.0 };
+
+		bool operator==(const arrival_t&) const = default;
+	};
+
+	struct weighted_prediction_t {
+		blk_info_t info_{};
+		uint64_t weight_{ 0 };
+		arrival_t arrival_{};
+
+		bool operator==(const weighted_prediction_t&) const = default;
+	};
+
+	struct scored_prediction_t {
+		blk_info_t info_{};
+		double confidence_{ 0.0 }; // in (0, 1], the predictions of one call sum up to at most 1
+	};
+
+	/**
+	* @brief Learns a stream of requests and predicts the next ones. With stride_streams_ set,
+	* the requests of established sequential and strided streams are answered by a StrideDetector
+	* and never reach the engine, so it learns only the irregular requests. With region_levels_ set,
+	* every level learns the regions of the requests with an engine of its own, and predict() falls
+	* back to the finest level that predicts well enough when the exact keys predict nothing.
+	* With factorized_ set, the engine learns the requests without their sizes and a PPM table
+	* of context_order_ learns the sizes, predict() joins every predicted request with the likely
+	* next sizes, the other predictions take the most likely one.
+	* The keys are made by a policy of key_function_t that is inlined into every engine, predict(),
+	* predictAhead() and predict_top() change nothing and may be called from several threads
+	* at once, but not while another one inserts.
+	*/
 	class IOProphet
 	{
 	public:
 		using weight_t = uint64_t;
-		using predict_pack_t = std::vector<std::pair<blk_info_t, weight_t>>;
+		using predict_pack_t = std::vector<weighted_prediction_t>;
+		using published_t = utils::Published<predict_pack_t>;
 
 		IOProphet(const prophet_cfg_t& config);
 		IOProphet(IOProphet&&) noexcept;
@@ -27,20 +114,170 @@ namespace pIOn::model
 		IOProphet(const IOProphet&) = delete;
 		IOProphet& operator=(const IOProphet&) = delete;
 
+		/**
+		* @brief the next requests of the grammar and of the established streams, a stream is weighted by its run.
+		* If there are none, the regions of a region level as readahead hints: a hint starts at the region,
+		* or after the last request if it is in the region, and is at most region_readahead_ bytes long.
+		* The hints are not timed. The arrival of a request of the grammar is given by the times seen
+		* between the last symbol and its one, a stream arrives at the time of its request.
+		*/
 		[[nodiscard]] predict_pack_t predict() const;
+
+		/**
+		* @brief appends the next steps requests of every continuation that the grammar predicts.
+		* A request is timed from the last inserted one along its continuation and weighted by
+		* the frequency of the predicted symbol it follows. Allocates only to grow the result.
+		* The quantiles of the arrival are summed up along the continuation, so its spread is overstated.
+		* The established streams follow with their next steps requests.
+		*/
+		void predictAhead(size_t steps, predict_pack_t& result) const;
+
+		/**
+		* @brief the best distinct next requests, sorted by confidence. A candidate is supported by
+		* every continuation that starts with it, with the frequencies of the rules on its derivation
+		* path, and the support is scaled by how often the candidate came true when it was predicted.
+		*
+		* @return the number of predictions written to out, at most out.size()
+		*/
+		size_t predict_top(std::span<scored_prediction_t> out) const;
+
 		[[nodiscard]] size_t getGrammarSize() const;
+		[[nodiscard]] sequitur::grammar_stats_t getGrammarStats() const;
+
+		/**
+		* @brief bytes held by the grammar, the time table and the statistics of the hits.
+		* Walks the grammar, so it is meant for reports rather than for every insert.
+		*/
+		[[nodiscard]] sequitur::memory_usage_t memory_usage() const;
+
+		// Bytes of the live grammar, time table and statistics of the hits in O(1), see Predictor::footprint
+		[[nodiscard]] size_t footprint() const noexcept;
+		[[nodiscard]] prediction_stats_t getPredictionStats() const noexcept;
 		void setGrammarSizeLimits(size_t limit);
+		void setGrammarLimitPolicy(sequitur::limit_policy_t policy);
+		void setPublishPredictions(bool publish);
+
+		/**
+		* @brief keeps footprint() under bytes, 0 turns the limit off. Once an insert exceeds it,
+		* the grammars, with the region levels and the size model, are trimmed in the same proportion
+		* with the limit policy to make room for the next inserts, and the time table is cleared if it
+		* takes most of the budget. Works along with the grammar limits.
+		*/
+		void setMemoryLimit(size_t bytes);
+		[[nodiscard]] size_t getMemoryLimit() const noexcept;
+
+		/**
+		* @brief the predictions made after the last insert, load or batch. Unlike predict(),
+		* it may be called from any number of threads while another one inserts: the reader
+		* never waits and holds an immutable pack until it is destroyed.
+		* Empty unless the publication is enabled.
+		*/
+		[[nodiscard]] published_t::reader_t getPublishedPredictions() const noexcept;
 		void insert(const blk_info_t& info);
 
+		/**
+		* @brief same as insert() for every element, but keys are made and the grammar
+		* is updated per batch, see Predictor::insert_batch for predict_last_only.
+		* The grammar does not predict inside a batch, so only the requests taken by a stream
+		* are counted in getPredictionStats(), each as a hit.
+		*/
+		void insert_batch(std::span<const blk_info_t> infos, bool predict_last_only = false);
+
+		/**
+		* @brief saves the grammar, the predictors and the time statistics into a binary snapshot.
+		* The snapshot does not depend on the grammar storage, limits, streams, region levels,
+		* the size model and the base of the delta keys are not saved.
+		* Only the Sequitur engine with the keys that need no table can be saved.
+		*/
+		void save(std::string_view path) const;
+
+		/**
+		* @brief replaces the learned state with the one of a snapshot, the file is mapped
+		* into memory and read in place. Throws std::runtime_error if it is not a valid snapshot.
+		*/
+		void load(std::string_view path);
+
 	private:
 		double predictAverageTime() const;
+		arrival_t predictArrival(uint64_t prev_sym, uint64_t sym) const;
+
+		template<typename PredictorT>
+		double predictAverageTime(const PredictorT& predictor) const;
+
+		template<typename PredictorT, keys::key_holder KeyT>
+		void predict(const PredictorT& predictor, const KeyT& key, predict_pack_t& result) const;
 
-		uptr<pIOn::sequitur::Predictor> predictor_;
-		utils::PairMapAdapter<uint64_t, WeightedStats<double>> time_table_;
+		template<typename PredictorT, keys::key_holder KeyT>
+		void predictAhead(const PredictorT& predictor, const KeyT& key, size_t steps, predict_pack_t& result) const;
+
+		template<typename PredictorT, keys::key_holder KeyT>
+		size_t predict_top(const PredictorT& predictor, const KeyT& key, std::span<scored_prediction_t> out) const;
+
+		void predictStreams(predict_pack_t& result) const;
+		void predictRegions(predict_pack_t& result) const;
+		size_t fallbackLevel() const;
+
+		void publish();
+		void countHits(uint64_t sym, bool is_size_hit = true);
+		blk_info_t withoutSize(const blk_info_t& info) const noexcept;
+
+		// [size, weight] of the likely next sizes, the most likely first, a weight is in thousandths
+		using size_prediction_t = std::pair<uint64_t, uint64_t>;
+		static constexpr size_t MAX_SIZES = engines::ContextPredictor::WAYS;
+		size_t predictSizes(std::span<size_prediction_t> out) const;
+		bool isSizePredicted(uint64_t size) const;
+		void learnRegions(const blk_info_t& info, bool is_predicted);
+		void learnRegions(std::span<const blk_info_t> infos);
+		void checkMemoryLimit();
+		void clearTimes();
+		void forgetKeys();
+		void reserveKeys(size_t count); // forgets the interned keys if count new ones may not fit
+		uint64_t toKey(const blk_info_t& info);
+		size_t keyBytes() const noexcept;
+
+		using predictor_t = std::variant<uptr<pIOn::sequitur::Predictor>, uptr<pIOn::sequitur::CompactPredictor>, uptr<engines::ContextPredictor>>;
+		static predictor_t makePredictor(const prophet_cfg_t& config);
+
+		predictor_t predictor_;
+		utils::PairMapAdapter<uint64_t, SketchedStats<double>> time_table_;
 		
+		// How often a symbol came true when it was predicted, kept until the time table is cleared
+		// or there are more than hit_rates_limit_ of them, 0 - no bound
+		struct hit_rate_t
+		{
+			uint32_t predicted{};
+			uint32_t hits{};
+		};
+		utils::FlatMap<uint64_t, hit_rate_t> hit_rates_;
+		size_t hit_rates_limit_{ 0 };
+		utils::FlatMap<uint64_t, double> candidates_; // scratch of countHits
+		StrideDetector streams_;
+		std::vector<blk_info_t> batch_infos_; // requests of a batch that go to the grammar
+
+		// A grammar over the regions of one size, a key is [REGION | OP : 2]
+		struct region_level_t
+		{
+			uint64_t sectors{};
+			predictor_t predictor;
+			prediction_stats_t stats{}; // requests that came when the level predicted anything
+		};
+		std::vector<region_level_t> regions_;
+		uint64_t region_readahead_{ 0 };
+		blk_info_t last_info_{};              // the last request learned by the engines
+		uptr<engines::ContextPredictor> size_model_; // sizes of the requests if factorized
+		prediction_stats_t prediction_stats_;
+
+		std::vector<uint64_t> batch_keys_;
 		uint64_t prev_sym_{ 0 };
-		double prev_time_{ 0.0 };
+		double prev_time_{ 0.0 }; // the clock of the trace, the sum of the times of its requests
+
+		using key_holder_t = std::variant<keys::StandartKey, keys::DeltaKey, keys::InternedKey, keys::SectorKey, keys::OffsetKey>;
+		static key_holder_t makeKey(key_function_t function);
 
-		mutable uptr<keys::KeyHolder> key_;
+		key_holder_t key_;
+		uptr<published_t> published_; // always allocated, so that readers may hold it
+		bool is_publishing_{ false };
+		bool is_interning_{ false };
+		size_t memory_limit_{ 0 };
 	};
 }
\ No newline at end of file
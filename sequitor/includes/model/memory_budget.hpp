@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+
+#include "io_prophet.hpp"
+
+namespace pIOn::model
+{
+	struct budget_cfg_t {
+		size_t total_bytes_{ 64ULL << 20 }; // shared by all the prophets
+		size_t min_bytes_{ 256ULL << 10 };  // a prophet is never squeezed below it
+		double smoothing_{ 0.5 };           // weight of the last period in the value of a prophet
+	};
+
+	/**
+	* @brief Shares one memory budget between many prophets. Every rebalance values a prophet by
+	* the hits it made since the previous one, that is its I/O rate times its hit rate, and splits
+	* the budget in proportion to the values over a floor every prophet gets. The shares become
+	* the memory limits of the prophets, so the ones that lost memory trim or reset their grammars
+	* with their own limit policies at once. The hits of a prophet fed by batches are those of its streams.
+	*
+	* The budget holds pointers: a prophet must stay in place until it is detached.
+	*/
+	class MemoryBudget
+	{
+	public:
+		explicit MemoryBudget(const budget_cfg_t& config);
+		MemoryBudget(const MemoryBudget&) = delete;
+		MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+		/**
+		* @brief the prophet gets the floor until the next rebalance, so the budget may be
+		* exceeded by min_bytes_ for every prophet attached since then
+		*/
+		void attach(IOProphet& prophet);
+		void detach(const IOProphet& prophet);
+
+		// Must not run concurrently with the inserts of the attached prophets
+		void rebalance();
+
+		[[nodiscard]] size_t footprint() const noexcept;
+		[[nodiscard]] size_t size() const noexcept;
+		[[nodiscard]] const budget_cfg_t& getConfig() const noexcept;
+
+	private:
+		struct model_t
+		{
+			IOProphet* prophet{ nullptr };
+			prediction_stats_t seen{}; // stats at the previous rebalance
+			double value{ 0.0 };
+			bool is_new{ true };
+		};
+
+		size_t floor() const noexcept;
+
+		budget_cfg_t config_;
+		std::vector<model_t> models_;
+	};
+}
\ No newline at end of file
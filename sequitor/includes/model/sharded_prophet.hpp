@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <span>
+#include <exception>
+
+#include "io_prophet.hpp"
+#include "memory_budget.hpp"
+
+namespace pIOn::model
+{
+	// What makes the requests belong to the same stream
+	enum class shard_key_t : uint8_t
+	{
+		PID,        // process that issued the request
+		CPU,        // cpu (queue) the request was traced on
+		LBA_REGION  // aligned region of 2^region_bits_ sectors
+	};
+
+	struct sharded_cfg_t {
+		prophet_cfg_t prophet_{};               // config of every shard
+		shard_key_t key_{ shard_key_t::PID };
+		size_t workers_{ 0 };                   // 0 - one per hardware thread
+		size_t batch_size_{ 256 };              // requests a worker is handed at once
+		uint8_t region_bits_{ 21 };             // 1 GiB regions of 512-byte sectors
+		size_t memory_budget_{ 0 };             // bytes shared by all shards, 0 - every shard has prophet_.memory_limit_
+	};
+
+	/**
+	* @brief Demultiplexes one stream of requests into an IOProphet per shard key and
+	* trains the shards on a fixed pool of workers. A shard always lives on the same worker,
+	* so its requests are inserted in the order they were given, while different shards
+	* are trained in parallel.
+	*/
+	class ShardedProphet
+	{
+	public:
+		// Called on the worker thread before the request is inserted into its shard
+		using observer_t = std::function<void(uint64_t shard, const IOProphet& prophet, const blk_info_t& info)>;
+
+		explicit ShardedProphet(const sharded_cfg_t& config);
+		ShardedProphet(const ShardedProphet&) = delete;
+		ShardedProphet& operator=(const ShardedProphet&) = delete;
+		ShardedProphet(ShardedProphet&&) = delete;
+		ShardedProphet& operator=(ShardedProphet&&) = delete;
+		~ShardedProphet() noexcept;
+
+		[[nodiscard]] uint64_t shardOf(const blk_info_t& info) const noexcept;
+		void insert(const blk_info_t& info);
+		void insert_batch(std::span<const blk_info_t> infos);
+
+		// Hands the buffered requests to the workers and waits until they are inserted
+		void flush();
+
+		// Must be set before the first insert
+		void setObserver(observer_t observer);
+
+		/**
+		* @brief predictions of a shard made from the requests that are already inserted,
+		* call flush() before to account all of them. Empty if the shard has never been seen.
+		*/
+		[[nodiscard]] IOProphet::predict_pack_t predict(uint64_t shard) const;
+		[[nodiscard]] std::vector<uint64_t> getShards() const;
+		[[nodiscard]] size_t getWorkersCount() const noexcept;
+
+		/**
+		* @brief shares the memory budget between the shards by the hits they made since the
+		* previous call, see MemoryBudget. Flushes and stops the workers while it runs.
+		* Does nothing without the budget.
+		*/
+		void rebalance();
+
+		// Visits every shard after flush(), in no particular order
+		template<typename F>
+		void for_each(F&& func)
+		{
+			flush();
+			for (auto& worker : workers_) {
+				std::lock_guard lock{ worker->prophets_mutex };
+				for (const auto& [shard, prophet] : worker->prophets) {
+					func(shard, prophet);
+				}
+			}
+		}
+
+	private:
+		struct request_t
+		{
+			uint64_t shard{};
+			blk_info_t info{};
+		};
+
+		struct worker_t
+		{
+			std::mutex mutex; // guards queue, error, busy and stop
+			std::condition_variable has_work;
+			std::condition_variable is_idle;
+			std::vector<request_t> queue;  // handed over by the producer
+			std::vector<request_t> staged; // filled by the producer without locking
+			std::exception_ptr error;      // the first failure, rethrown by flush()
+			bool busy{ false };
+			bool stop{ false };
+
+			std::mutex prophets_mutex; // held while the worker inserts
+			std::unordered_map<uint64_t, IOProphet> prophets;
+			std::thread thread;
+		};
+
+		void run(worker_t& worker);
+		void submit(worker_t& worker);
+		worker_t& workerOf(uint64_t shard) const noexcept;
+
+		sharded_cfg_t config_;
+		observer_t observer_;
+		uptr<MemoryBudget> budget_;
+		std::mutex budget_mutex_; // taken after prophets_mutex
+		std::vector<uptr<worker_t>> workers_;
+	};
+}
\ No newline at end of file
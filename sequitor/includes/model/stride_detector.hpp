@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "blk_info.hpp"
+
+namespace pIOn::model
+{
+	/**
+	* @brief Follows a few interleaved streams of requests that go with a constant stride, or
+	* sequentially when the stride is the size of the previous request. A stream is established
+	* once it has kept its stride MIN_RUN times, then its next request is known without a grammar.
+	* The streams are replaced in the LRU order, a request that breaks an established stream
+	* starts a new one rather than retargets it, and the new one takes over the old one once they meet.
+	*/
+	class StrideDetector
+	{
+	public:
+		static constexpr uint32_t MIN_RUN = 2;
+		static constexpr uint64_t SECTOR_SIZE = 512;
+		static constexpr uint64_t MAX_DISTANCE = 1ULL << 16; // sectors between the requests of one stream
+
+		struct stream_t
+		{
+			uint64_t last_lba{};
+			uint64_t last_size{};
+			int64_t stride{};      // in sectors, the size of the last request if sequential
+			double last_time{};    // on the clock of the detector
+			double interval{};     // smoothed time between the requests of the stream
+			uint64_t last_use{};   // 0 - the slot is empty
+			uint32_t run{};        // strides kept, 0 - a single request
+			OPERATION op{ OPERATION::NONE };
+			bool sequential{ false };
+
+			[[nodiscard]] int64_t step() const noexcept;
+			[[nodiscard]] uint64_t next() const noexcept;
+		};
+
+		explicit StrideDetector(size_t streams = 0);
+
+		/**
+		* @brief feeds a request to the streams
+		*
+		* @return true if it is the next request of an established stream, so it has been predicted
+		*/
+		bool observe(const blk_info_t& info);
+
+		// Calls func(const stream_t&) for every established stream
+		template<typename F>
+		void for_each_stream(F&& func) const;
+
+		/**
+		* @brief the request steps ahead of an established stream, steps = 1 is the next one.
+		* Timed from the last observed request.
+		*/
+		[[nodiscard]] blk_info_t predict(const stream_t& stream, size_t steps = 1) const noexcept;
+
+		[[nodiscard]] bool enabled() const noexcept;
+		[[nodiscard]] size_t size() const noexcept; // established streams
+		[[nodiscard]] size_t bytes() const noexcept;
+		void clear() noexcept;
+
+	private:
+		// Smoothing of stream_t::interval
+		static constexpr double INTERVAL_WEIGHT = 0.25;
+
+		stream_t* nearest(const blk_info_t& info) noexcept;
+		stream_t& leastRecent() noexcept;
+		// Drops the other streams that have come to the same request with the same step, keeps the longest run
+		void merge(stream_t& stream) noexcept;
+
+		std::vector<stream_t> streams_;
+		uint64_t tick_{ 0 };
+		double now_{ 0.0 }; // the sum of the times of the observed requests
+	};
+
+	template<typename F>
+	void StrideDetector::for_each_stream(F&& func) const
+	{
+		for (const stream_t& stream : streams_) {
+			if (stream.run >= MIN_RUN) {
+				func(stream);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -10,13 +10,20 @@
 #include <set>
 #include <list>
 #include <vector>
-#include <unordered_map>
 #include <stack>
+#include <span>
+#include <array>
+#include <algorithm>
 #include "utils/iterator_range.hpp"
 #include "types.hpp"
 #include "rules.hpp"
 #include "symbols.hpp"
-#include "utils/hashing.hpp"
+#include "utils/digram_table.hpp"
+#include "utils/flat_map.hpp"
+#include "stats/grammar_stats.hpp"
+#include "stats/memory_usage.hpp"
+#include "limit_policy.hpp"
+#include "grammar_snapshot.hpp"
 #include "utils/object_pool.hpp"
 
 namespace pIOn::sequitur {
@@ -32,21 +39,38 @@ namespace pIOn::sequitur {
 
 		std::set<Rules*> rules_set_;
 		std::set<Symbols*> predictions_;
-		std::unordered_map<std::pair<uint64_t, uint64_t>, Symbols*> index_;
+		utils::DigramTable<Symbols*> index_;
+		utils::FlatMap<uint64_t, Symbols*> occurrences_; // value -> list of the symbols having it
 
 		std::vector<Rules*> rules_;
 		uint64_t rule_idx_{};
+		size_t symbols_count_{}; // sum of Rules::length_, maintained by Rules::resize
 		uint64_t version_{}; // For iterator validation and limits checks
 		size_t limit_{ ~0ULL }; // Grammar limit 
+		limit_policy_t policy_{ limit_policy_t::RESET };
+		std::vector<Rules*> evicted_rules_; // rules that lost their last user during the eviction
+
+		// Upper bound of the index presizing, so a big or unbounded limit costs nothing up front,
+		// bigger grammars grow the index by its load factor
+		static constexpr size_t INDEX_PRESIZE_LIMIT = 1ULL << 12;
 
 		// Perform operations with the index
 		Symbols* find_digram(Symbols* s);
 		void delete_digram(Symbols* s);
 		void set_digram(Symbols* s);
 
+		// Keep the lists of occurrences, that find_new_predictors walks
+		void link_occurrence(Symbols* s);
+		void unlink_occurrence(Symbols* s) noexcept;
+
 		void find_new_predictors(Symbols* s);
+		void clear_predictors(Symbols* s);
+		void append(uint64_t x, bool predict);
 		void print_rule(std::ostream& stream, Rules* r);
 		bool checkLimits();
+		void reset();
+		void evict_oldest();
+		void forget(Symbols* s);
 
 		void add_prediction(Symbols* s) {
 			predictions_.insert(s);
@@ -60,8 +84,6 @@ namespace pIOn::sequitur {
 			return rules_set_.size();
 		}
 
-		std::list<std::stack<Symbols*>> build_predictor_stack_from(Symbols* s) const;
-
 		// ObjectPool API
 		utils::ObjectPool<Rules> rulesPool;
 		utils::ObjectPool<Symbols> symbolsPool;
@@ -89,7 +111,7 @@ namespace pIOn::sequitur {
 			}
 		}
 
-		void clearSpace() noexcept;
+		void discard() noexcept;
 	public:
 		Predictor();
 		Predictor(const Predictor&) = delete;
@@ -100,6 +122,54 @@ namespace pIOn::sequitur {
 
 		using iterator_range = IteratorRange<std::set<Symbols*>::iterator>;
 
+		/**
+		* @brief position in the continuation that a predictor promises: the path of symbols
+		* from the axiom down to the current terminal. The path is kept inline, so copying and
+		* advancing a cursor never allocates. A path deeper than MAX_DEPTH loses its outermost
+		* symbols, such a cursor ends once the inner rules are read.
+		*/
+		class cursor
+		{
+		public:
+			static constexpr size_t MAX_DEPTH = 48;
+
+			cursor() = default;
+
+			uint64_t operator*() const; // current terminal, 0 at the end
+			cursor& operator++();
+			size_t advance(size_t steps); // returns the number of steps made
+
+			// Copies the current terminal and the following ones, the cursor moves past them
+			size_t read(std::span<uint64_t> out);
+
+			bool done() const noexcept { return depth_ == 0; }
+			bool truncated() const noexcept { return truncated_; }
+			uint64_t freq() const noexcept { return freq_; } // of the predicted symbol the cursor started from
+			uint64_t support() const noexcept { return support_; } // sum of freq() along the starting path
+
+		private:
+			friend class Predictor;
+			void push(Symbols* s) noexcept;
+			void check() const;
+
+			class invalid_cursor : public std::exception
+			{
+			public:
+				const char* what() const noexcept override
+				{
+					return "Invalid cursor";
+				}
+			};
+
+			std::array<Symbols*, MAX_DEPTH> path_{};
+			const Predictor* parent_{ nullptr };
+			uint64_t version_{};
+			uint64_t freq_{};
+			uint64_t support_{};
+			size_t depth_{ 0 };
+			bool truncated_{ false };
+		};
+
 		class iterator 
 		{
 		private:
@@ -109,6 +179,7 @@ namespace pIOn::sequitur {
 			int64_t version;
 			iterator(const Predictor* p, Symbols* start = nullptr);
 			iterator(const Predictor* p, std::stack<Symbols*>& s, Symbols* start = nullptr);
+			iterator(const Predictor* p, const cursor& c);
 
 			class invalid_iterator : public std::exception 
 			{
@@ -145,14 +216,115 @@ namespace pIOn::sequitur {
 		}
 
 		bool insert(uint64_t x);
+
+		/**
+		* @brief inserts the symbols one after another, checking the limits and invalidating
+		* the iterators once per batch rather than once per symbol.
+		*
+		* @param predict_last_only if true, the predictors are not followed inside the batch, they
+		* are rebuilt for the last symbol only. The grammar is the same, but predictions that rely
+		* on a longer context are lost. Meant for offline training.
+		*
+		* @return false if the grammar has been reset during the batch
+		*/
+		bool insert_batch(std::span<const uint64_t> xs, bool predict_last_only = false);
 		std::list<uint64_t> predict_next() const;
 		std::list<iterator> predict_all() const;
 		iterator_range predict_range() const;
+
+		/**
+		* @brief calls func(cursor) for every continuation of the input, in the order of predict_all().
+		* Nothing is allocated, a cursor is valid until the next insert.
+		*/
+		template<typename F>
+		void for_each_cursor(F&& func) const;
+
 		size_t size() const;
+		grammar_stats_t stats() const;
+
+		// Walks the rules to find the spilled sets, O(grammar size)
+		memory_usage_t memory_usage() const;
+
+		/**
+		* @brief bytes of the live symbols, rules and entries of the grammar in O(1). The spilled sets
+		* are not counted, the containers may hold more while they grow or after the grammar shrinks.
+		*/
+		size_t footprint() const noexcept;
+
+		/**
+		* @brief brings the grammar below limit symbols the way the limit policy does it
+		*
+		* @return false if the grammar has been reset
+		*/
+		bool trim(size_t limit);
 		void setLimits(size_t limit);
+		void setLimitPolicy(limit_policy_t policy) noexcept;
+
+		// Symbols and rules allocated afterwards live on transparent huge pages (Linux only)
+		void setHugePages(bool huge_pages) noexcept;
+
+		// Grammar and predictors in the layout of grammar_snapshot.hpp, limits are not saved
+		void save(utils::SnapshotWriter& writer) const;
+		void load(utils::SnapshotReader& reader);
 
 		friend std::ostream& operator<<(std::ostream& stream, Predictor& o);
 	};
 
 	std::ostream& operator<<(std::ostream& stream, Predictor& o);
+
+	template<typename F>
+	void Predictor::for_each_cursor(F&& func) const
+	{
+		// path_ of the cursor holds the predictors above s, the walk is a depth-first search over them
+		cursor c;
+		c.parent_ = this;
+		c.version_ = version_;
+		size_t depth = 0;
+		std::vector<Symbols*> outer; // the outermost part of a path deeper than the cursor holds
+
+		Symbols* s = root_->rule()->first();
+		LOOP
+		{
+			if (s->is_guard()) {
+				if (depth == 0) {
+					return;
+				}
+				s = c.path_[--depth]->next();
+				if (!outer.empty()) {
+					std::move_backward(c.path_.begin(), c.path_.begin() + depth, c.path_.begin() + depth + 1);
+					c.path_[0] = outer.back();
+					outer.pop_back();
+					++depth;
+				}
+				continue;
+			}
+
+			if (s->is_pred() && s->nt()) {
+				// the terminal takes the last place of the path, deeper paths keep their outermost symbols aside
+				if (depth + 1 == cursor::MAX_DEPTH) {
+					outer.push_back(c.path_[0]);
+					std::move(c.path_.begin() + 1, c.path_.begin() + depth, c.path_.begin());
+					--depth;
+				}
+				c.path_[depth++] = s;
+				s = s->rule()->first();
+				continue;
+			}
+			if (s->is_pred() && s->term()) {
+				c.path_[depth] = s;
+				c.depth_ = depth + 1;
+				c.freq_ = s->freq();
+				c.truncated_ = !outer.empty();
+				c.support_ = 0;
+				for (Symbols* o : outer) {
+					c.support_ += o->freq();
+				}
+				for (size_t i = 0; i < c.depth_; ++i) {
+					c.support_ += c.path_[i]->freq();
+				}
+				func(cursor{ c });
+			}
+			s = s->next();
+		}
+	}
 }
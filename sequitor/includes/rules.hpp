@@ -9,6 +9,7 @@
 #include <set>
 #include <functional>
 #include "types.hpp"
+#include "utils/small_set.hpp"
 
 namespace pIOn::sequitur {
 
@@ -17,19 +18,31 @@ namespace pIOn::sequitur {
 
 	class Rules
 	{
+	public:
+		using users_set_t = utils::SmallFlatSet<Symbols*, 2>;
+
 	private:
+		friend class Symbols;
+		friend class Predictor;
+
 		// The guard node in the linked list of symbols that make up the rule
 		// It points forward to the first symbol in the rule, and backwards
 		// to the last symbol in the rule. Its own value points to the rule data
 		// structure, so that symbols can find out which rule they're in
 		Symbols* guard_;
 
-		// Chains that using this rule
-		std::set<Symbols*> users_;
+		// Chains that using this rule, most rules have two users
+		users_set_t users_;
+
+		// Number of symbols in the rule, kept up to date by Symbols
+		size_t length_{};
 
 		// For inner using
 		uint64_t idx_{};
 		Predictor* predictor_{ nullptr };
+
+		// a symbol has been linked into (delta > 0) or unlinked from (delta < 0) the rule
+		void resize(int64_t delta) noexcept;
 	public:
 		Rules() = delete;
 		Rules(const Rules&) = delete;
@@ -46,14 +59,15 @@ namespace pIOn::sequitur {
 		Symbols* first() const;
 		Symbols* last() const;
 		size_t length() const;
+		bool empty() const noexcept { return length_ == 0; };
 		void for_each(std::function<void(Symbols*)> func) noexcept;
 
 		uint64_t freq() const noexcept { return users_.size(); };
 		uint64_t index() const noexcept { return idx_; };
 		void index(uint64_t idx) { idx_ = idx; };
 		Predictor* get_predictor() const noexcept { return predictor_; };
-		std::set<Symbols*>& get_users() noexcept { return users_; };
-		const std::set<Symbols*>& get_users() const noexcept { return users_; };
+		users_set_t& get_users() noexcept { return users_; };
+		const users_set_t& get_users() const noexcept { return users_; };
 		const Symbols* get_guard() const noexcept { return guard_; };
 	};
 
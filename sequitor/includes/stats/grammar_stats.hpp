@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+namespace pIOn::sequitur
+{
+	// Counters that the grammar keeps up to date on every change, reading them is O(1)
+	struct grammar_stats_t
+	{
+		size_t symbols{ 0 };     // symbols in the right-hand sides of all rules
+		size_t rules{ 0 };       // rules including the axiom
+		size_t digrams{ 0 };     // entries of the digram index
+		size_t predictions{ 0 }; // terminals that are currently predicted
+	};
+}
\ No newline at end of file
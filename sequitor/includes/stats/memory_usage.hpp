@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+
+namespace pIOn::sequitur
+{
+	/**
+	* @brief Bytes held by the structures of a grammar, as allocated from the heap without the allocator's
+	* own overhead. Containers count their capacity, not their size, and pools count whole chunks.
+	*/
+	struct memory_usage_t
+	{
+		size_t symbols{ 0 };        // symbol pool or links of the compact symbols
+		size_t rules{ 0 };          // rule pool or rule array, with the set of rules
+		size_t digram_index{ 0 };
+		size_t occurrences{ 0 };    // lists of the symbols having the same value
+		size_t predictor_sets{ 0 }; // predictor sets of the symbols that do not fit into the symbols
+		size_t users_sets{ 0 };     // users of the rules that do not fit into the rules
+		size_t predictions{ 0 };    // terminals that are currently predicted
+		size_t contexts{ 0 };       // context table of engines::ContextPredictor
+		size_t time_table{ 0 };     // IOProphet only
+		size_t keys{ 0 };           // IOProphet only, table of keys::InternedKey
+		size_t regions{ 0 };        // IOProphet only, everything held by the engines of the region levels
+		size_t other{ 0 };          // free lists, scratch buffers, statistics of the hits
+
+		[[nodiscard]] size_t total() const noexcept
+		{
+			return symbols + rules + digram_index + occurrences + predictor_sets + users_sets + predictions + contexts + time_table + keys + regions + other;
+		}
+	};
+
+	// Size of a node of std::set and std::map: the value, the color and three links
+	template<typename T>
+	inline constexpr size_t tree_node_bytes = sizeof(T) + 4 * sizeof(void*);
+}
\ No newline at end of file
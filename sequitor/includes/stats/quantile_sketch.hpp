@@ -0,0 +1,133 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+namespace pIOn
+{
+	/**
+	* @brief Distribution of non-negative values in BUCKETS counters of one byte. The buckets grow by
+	* sqrt(2) from MIN_VALUE, so a quantile is within that ratio of the true one, the values below
+	* MIN_VALUE share the first bucket and the ones above the range the last. A counter that would
+	* overflow halves all of them, rounding up, so the older values fade away but the rare ones stay. Two sketches merge by their counters.
+	*/
+	class QuantileSketch
+	{
+	public:
+		static constexpr size_t BUCKETS = 64;
+		static constexpr double MIN_VALUE = 1.0 / (1 << 20); // about a microsecond for the times in seconds
+
+		void insert(double x) noexcept
+		{
+			uint8_t& count = counts_[bucketOf(x)];
+			if (count == UINT8_MAX) {
+				halve();
+			}
+			++count;
+		}
+
+		void merge(const QuantileSketch& other) noexcept
+		{
+			// both sides fade together, so the merged counters keep their shares
+			QuantileSketch added = other;
+			while (!fits(added)) {
+				halve();
+				added.halve();
+			}
+			for (size_t i = 0; i < BUCKETS; ++i) {
+				counts_[i] = static_cast<uint8_t>(counts_[i] + added.counts_[i]);
+			}
+		}
+
+		// q from [0, 1], 0 if nothing has been inserted
+		[[nodiscard]] double quantile(double q) const noexcept
+		{
+			const uint32_t total = count();
+			if (total == 0) {
+				return 0.0;
+			}
+
+			// the rank is spread evenly over the bucket, geometrically as the buckets themselves
+			double rank = std::clamp(q, 0.0, 1.0) * total;
+			for (size_t i = 0; i < BUCKETS; ++i) {
+				if (counts_[i] == 0 || rank > counts_[i]) {
+					rank -= counts_[i];
+					continue;
+				}
+
+				const double share = rank / counts_[i];
+				if (i == 0) {
+					return share * MIN_VALUE;
+				}
+				return lowerBound(i) * std::pow(std::sqrt(2.0), share);
+			}
+
+			return lowerBound(BUCKETS - 1);
+		}
+
+		[[nodiscard]] uint32_t count() const noexcept
+		{
+			uint32_t result = 0;
+			for (uint8_t count : counts_) {
+				result += count;
+			}
+			return result;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return std::all_of(counts_.cbegin(), counts_.cend(), [](uint8_t count) {
+				return count == 0;
+			});
+		}
+
+		void clear() noexcept
+		{
+			counts_.fill(0);
+		}
+
+	private:
+		// Bucket 0 is [0, MIN_VALUE), bucket i is [MIN_VALUE * 2^((i - 1) / 2), MIN_VALUE * 2^(i / 2))
+		static size_t bucketOf(double x) noexcept
+		{
+			if (!(x >= MIN_VALUE)) {
+				return 0;
+			}
+
+			// x / MIN_VALUE = m * 2^e with m from [0.5, 1), the half of the octave is set by m against sqrt(2) / 2
+			int e = 0;
+			const double m = std::frexp(x / MIN_VALUE, &e);
+			const size_t bucket = 1 + 2 * static_cast<size_t>(e - 1) + (m >= HALF_SQRT2);
+			return std::min(bucket, BUCKETS - 1);
+		}
+
+		static double lowerBound(size_t bucket) noexcept
+		{
+			return std::ldexp(MIN_VALUE, static_cast<int>(bucket - 1) / 2) * ((bucket - 1) % 2 ? std::sqrt(2.0) : 1.0);
+		}
+
+		// Rounds up, so a rare value of the tail fades but is never wiped out by the others
+		void halve() noexcept
+		{
+			for (uint8_t& count : counts_) {
+				count = static_cast<uint8_t>((count + 1) / 2);
+			}
+		}
+
+		[[nodiscard]] bool fits(const QuantileSketch& other) const noexcept
+		{
+			for (size_t i = 0; i < BUCKETS; ++i) {
+				if (counts_[i] + other.counts_[i] > UINT8_MAX) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static constexpr double HALF_SQRT2 = 0.70710678118654752440;
+
+		std::array<uint8_t, BUCKETS> counts_{};
+	};
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include "weighted_stats.hpp"
+#include "quantile_sketch.hpp"
+
+namespace pIOn
+{
+	// WeightedStats that also keep the distribution of the values, see QuantileSketch for its bounds
+	template<typename T>
+	class SketchedStats : public WeightedStats<T>
+	{
+	public:
+		void insert(const T& x) override
+		{
+			WeightedStats<T>::insert(x);
+			sketch_.insert(static_cast<double>(x));
+		}
+
+		const QuantileSketch& getSketch() const {
+			return sketch_;
+		}
+
+		void setSketch(const QuantileSketch& sketch) {
+			sketch_ = sketch;
+		}
+
+	private:
+		QuantileSketch sketch_;
+	};
+}
\ No newline at end of file
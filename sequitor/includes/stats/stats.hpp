@@ -9,6 +9,16 @@ namespace pIOn
 	class Stats
 	{
 	public:
+		// Plain copy of the accumulated values, to save and restore them
+		struct state_t
+		{
+			uint32_t n{ 0 };
+			double mean{ 0.0 };
+			double var{ 0.0 };
+			T min{};
+			T max{};
+		};
+
 		virtual ~Stats() = default;
 
 		virtual void insert(const T& x);
@@ -33,6 +43,18 @@ namespace pIOn
 			return n_;
 		}
 
+		state_t getState() const {
+			return { n_, mean_, var_, min_, max_ };
+		}
+
+		void setState(const state_t& state) {
+			n_ = state.n;
+			mean_ = state.mean;
+			var_ = state.var;
+			min_ = state.min;
+			max_ = state.max;
+		}
+
 		template<typename U>
 		friend std::ostream& operator<<(std::ostream& os, const Stats<U>& s);
 
@@ -15,6 +15,10 @@ namespace pIOn
 			return weighted_stats_;
 		}
 
+		void setStats(const T& weighted) {
+			weighted_stats_ = weighted;
+		}
+
 	private:
 		T weighted_stats_{};
 	};
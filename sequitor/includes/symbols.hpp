@@ -9,11 +9,17 @@
 #include <iostream>
 #include "types.hpp"
 #include "rules.hpp"
+#include "utils/small_set.hpp"
 
 namespace pIOn::sequitur {
 
 	class Symbols 
 	{
+		friend class Predictor;
+	public:
+		// Almost every symbol predicts 0-3 others, so the sets live inline in the symbol
+		using predictors_set_t = utils::SmallFlatSet<Symbols*, 3>;
+
 	private:
 		Symbols* next_{ nullptr };
 		Symbols* prev_{ nullptr };
@@ -21,9 +27,12 @@ namespace pIOn::sequitur {
 
 		Rules* owner_{ nullptr };                // indicates in which rule this symbol appears
 
-		std::set<Symbols*> predictors_;
-		std::set<Symbols*> next_new_predictor_;  // next set of new predictors
-		std::set<Symbols*> next_stay_predictor_; // predictors that stay predictors
+		Symbols* next_occurrence_{ nullptr };    // other symbols with the same value, see Predictor::occurrences_
+		Symbols* prev_occurrence_{ nullptr };
+
+		predictors_set_t predictors_;
+		predictors_set_t next_new_predictor_;    // next set of new predictors
+		predictors_set_t next_stay_predictor_;   // predictors that stay predictors
 
 		bool is_predictor_{ false };
 		bool is_terminal_{ true };
@@ -88,10 +97,7 @@ namespace pIOn::sequitur {
 		}
 
 		// inserts a symbol after this one.
-		void insert_after(Symbols* y) {
-			join(y, next_);
-			join(this, y);
-		};
+		void insert_after(Symbols* y);
 
 		// true if this is the guard node marking the beginning/end of a rule
 		bool is_guard() noexcept {
@@ -129,6 +135,9 @@ namespace pIOn::sequitur {
 		// Notify the users of this symbol that it has been transformed into a predictor.
 		void become_predictor_up(Symbols* child);
 
+		// Cancels the predictions that go through this symbol before it leaves the grammar.
+		void drop_predictors();
+
 		/**
 		* @brief Reqursively incrementing all predictors.
 		* update_predictors should be called to make these next values the current ones.
@@ -149,8 +158,8 @@ namespace pIOn::sequitur {
 		void update_predictors();
 
 		/**
-		* @brief search for predictors in the rull in which this symbol appears,
-		* given the last symbol read (this symbol might be a non-terminal).
+		* @brief this symbol is an earlier occurrence of the last symbol read (which might be
+		* a non-terminal), so it and the rule in which it appears become predictors.
 		*/ 
 		void find_potential_predictors(Symbols* matching);
 
@@ -0,0 +1,234 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "utils/hashing.hpp"
+
+namespace pIOn::utils
+{
+	/**
+	* @brief Flat open-addressing (linear probing) map from a digram (two symbols)
+	* to the symbol that starts it. Keys are stored inline with the value, so a lookup
+	* touches one cache line in the common case. Deletion shifts the following entries
+	* back instead of leaving tombstones, so probe chains do not degrade over time.
+	*
+	* An empty slot is marked by a value-initialized T (nullptr, handle 0), hence it
+	* cannot be stored as a value.
+	*/
+	template<typename T>
+	class DigramTable
+	{
+	public:
+		DigramTable() = default;
+		DigramTable(const DigramTable&) = delete;
+		DigramTable& operator=(const DigramTable&) = delete;
+
+		explicit DigramTable(size_t expected)
+		{
+			reserve(expected);
+		}
+
+		DigramTable(DigramTable&& other) noexcept
+		{
+			this->operator=(std::move(other));
+		}
+
+		DigramTable& operator=(DigramTable&& other) noexcept
+		{
+			if (this != std::addressof(other)) {
+				slots_ = std::move(other.slots_);
+				mask_ = std::exchange(other.mask_, 0);
+				size_ = std::exchange(other.size_, 0);
+				other.slots_.clear();
+			}
+
+			return *this;
+		}
+
+		[[nodiscard]] T find(uint64_t first, uint64_t second) const noexcept
+		{
+			if (size_ == 0) {
+				return T{};
+			}
+
+			for (size_t i = home(first, second);; i = (i + 1) & mask_) {
+				const slot_t& slot = slots_[i];
+				if (slot.value == T{}) {
+					return T{};
+				}
+				if (slot.first == first && slot.second == second) {
+					return slot.value;
+				}
+			}
+		}
+
+		/**
+		* @brief maps the digram to value, overwriting the previous mapping if any
+		*/
+		void assign(uint64_t first, uint64_t second, T value)
+		{
+			if ((size_ + 1) * MAX_LOAD_DEN > slots_.size() * MAX_LOAD_NUM) {
+				rehash(slots_.empty() ? MIN_CAPACITY : slots_.size() * 2);
+			}
+
+			for (size_t i = home(first, second);; i = (i + 1) & mask_) {
+				slot_t& slot = slots_[i];
+				if (slot.value == T{}) {
+					slot = slot_t{ first, second, value };
+					++size_;
+					return;
+				}
+				if (slot.first == first && slot.second == second) {
+					slot.value = value;
+					return;
+				}
+			}
+		}
+
+		/**
+		* @brief removes the digram only if it is mapped to the expected value
+		*
+		* @return true if the digram has been removed
+		*/
+		bool erase(uint64_t first, uint64_t second, T expected) noexcept
+		{
+			if (size_ == 0) {
+				return false;
+			}
+
+			size_t i = home(first, second);
+			for (;; i = (i + 1) & mask_) {
+				const slot_t& slot = slots_[i];
+				if (slot.value == T{}) {
+					return false;
+				}
+				if (slot.first == first && slot.second == second) {
+					break;
+				}
+			}
+
+			if (slots_[i].value != expected) {
+				return false;
+			}
+
+			// backward shift: pull up every following entry whose probe path crosses the hole
+			for (size_t j = (i + 1) & mask_; slots_[j].value != T{}; j = (j + 1) & mask_) {
+				const size_t h = home(slots_[j].first, slots_[j].second);
+				if (((j - h) & mask_) >= ((j - i) & mask_)) {
+					slots_[i] = slots_[j];
+					i = j;
+				}
+			}
+
+			slots_[i] = slot_t{};
+			--size_;
+			return true;
+		}
+
+		/**
+		* @brief prepares the table for the expected number of digrams, so that
+		* no rehash happens until it is exceeded
+		*/
+		void reserve(size_t expected)
+		{
+			size_t capacity = MIN_CAPACITY;
+			while (capacity * MAX_LOAD_NUM < expected * MAX_LOAD_DEN) {
+				capacity *= 2;
+			}
+
+			if (capacity > slots_.size()) {
+				rehash(capacity);
+			}
+		}
+
+		// Visits the value of every digram, in no particular order
+		template<typename F>
+		void for_each(F&& func) const
+		{
+			for (const slot_t& slot : slots_) {
+				if (slot.value != T{}) {
+					func(slot.value);
+				}
+			}
+		}
+
+		// Keeps the allocated slots
+		void clear() noexcept
+		{
+			if (size_ != 0) {
+				std::fill(slots_.begin(), slots_.end(), slot_t{});
+				size_ = 0;
+			}
+		}
+
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return size_;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return size_ == 0;
+		}
+
+		[[nodiscard]] size_t capacity() const noexcept
+		{
+			return slots_.size();
+		}
+
+		// Memory held by the slots
+		[[nodiscard]] size_t bytes() const noexcept
+		{
+			return slots_.capacity() * sizeof(slot_t);
+		}
+
+		// Memory the entries need at the maximum load, O(1)
+		[[nodiscard]] size_t live_bytes() const noexcept
+		{
+			return size_ * sizeof(slot_t) * MAX_LOAD_DEN / MAX_LOAD_NUM;
+		}
+
+	private:
+		struct slot_t
+		{
+			uint64_t first{};
+			uint64_t second{};
+			T value{};
+		};
+
+		static constexpr size_t MIN_CAPACITY = 16;
+		static constexpr size_t MAX_LOAD_NUM = 7;  // max load factor is 7/10
+		static constexpr size_t MAX_LOAD_DEN = 10;
+
+		std::vector<slot_t> slots_;
+		size_t mask_{ 0 };
+		size_t size_{ 0 };
+
+		size_t home(uint64_t first, uint64_t second) const noexcept
+		{
+			return static_cast<size_t>(mix128to64(first, second)) & mask_;
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<slot_t> old(capacity);
+			old.swap(slots_);
+			mask_ = capacity - 1;
+
+			for (const slot_t& slot : old) {
+				if (slot.value == T{}) {
+					continue;
+				}
+
+				size_t i = home(slot.first, slot.second);
+				while (slots_[i].value != T{}) {
+					i = (i + 1) & mask_;
+				}
+				slots_[i] = slot;
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,240 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "utils/hashing.hpp"
+
+namespace pIOn::utils
+{
+	/**
+	* @brief Open-addressing (linear probing) hash map with inline keys and values and
+	* backward-shift deletion. Unlike DigramTable any key and value can be stored.
+	* Pointers returned by find/operator[] are invalidated by the next insert or erase.
+	*/
+	template<typename Key, typename Value, typename Hash = flat_hash<Key>>
+	class FlatMap
+	{
+	public:
+		FlatMap() = default;
+		FlatMap(const FlatMap&) = default;
+		FlatMap& operator=(const FlatMap&) = default;
+
+		FlatMap(FlatMap&& other) noexcept
+		{
+			this->operator=(std::move(other));
+		}
+
+		FlatMap& operator=(FlatMap&& other) noexcept
+		{
+			if (this != std::addressof(other)) {
+				slots_ = std::move(other.slots_);
+				mask_ = std::exchange(other.mask_, 0);
+				size_ = std::exchange(other.size_, 0);
+				other.slots_.clear();
+			}
+
+			return *this;
+		}
+
+		[[nodiscard]] Value* find(const Key& key) noexcept
+		{
+			const size_t i = locate(key);
+			return i == NPOS ? nullptr : &slots_[i].value;
+		}
+
+		[[nodiscard]] const Value* find(const Key& key) const noexcept
+		{
+			const size_t i = locate(key);
+			return i == NPOS ? nullptr : &slots_[i].value;
+		}
+
+		[[nodiscard]] bool contains(const Key& key) const noexcept
+		{
+			return locate(key) != NPOS;
+		}
+
+		/**
+		* @brief finds the key or inserts it with a value-initialized value
+		*
+		* @return the value and true if it has been inserted
+		*/
+		std::pair<Value*, bool> try_emplace(const Key& key)
+		{
+			if ((size_ + 1) * MAX_LOAD_DEN > slots_.size() * MAX_LOAD_NUM) {
+				rehash(slots_.empty() ? MIN_CAPACITY : slots_.size() * 2);
+			}
+
+			for (size_t i = home(key);; i = (i + 1) & mask_) {
+				slot_t& slot = slots_[i];
+				if (!slot.used) {
+					slot.key = key;
+					slot.value = Value{};
+					slot.used = true;
+					++size_;
+					return { &slot.value, true };
+				}
+				if (slot.key == key) {
+					return { &slot.value, false };
+				}
+			}
+		}
+
+		Value& operator[](const Key& key)
+		{
+			return *try_emplace(key).first;
+		}
+
+		bool erase(const Key& key)
+		{
+			size_t i = locate(key);
+			if (i == NPOS) {
+				return false;
+			}
+
+			// backward shift: pull up every following entry whose probe path crosses the hole
+			for (size_t j = (i + 1) & mask_; slots_[j].used; j = (j + 1) & mask_) {
+				const size_t h = home(slots_[j].key);
+				if (((j - h) & mask_) >= ((j - i) & mask_)) {
+					slots_[i] = std::move(slots_[j]);
+					i = j;
+				}
+			}
+
+			slots_[i] = slot_t{};
+			--size_;
+			return true;
+		}
+
+		void reserve(size_t expected)
+		{
+			size_t capacity = MIN_CAPACITY;
+			while (capacity * MAX_LOAD_NUM < expected * MAX_LOAD_DEN) {
+				capacity *= 2;
+			}
+
+			if (capacity > slots_.size()) {
+				rehash(capacity);
+			}
+		}
+
+		// Keeps the allocated slots
+		void clear()
+		{
+			if (size_ != 0) {
+				for (slot_t& slot : slots_) {
+					slot = slot_t{};
+				}
+				size_ = 0;
+			}
+		}
+
+		template<typename F>
+		void for_each(F&& func) const
+		{
+			for (const slot_t& slot : slots_) {
+				if (slot.used) {
+					func(slot.key, slot.value);
+				}
+			}
+		}
+
+		// The values may be changed, but nothing may be inserted or erased meanwhile
+		template<typename F>
+		void for_each(F&& func)
+		{
+			for (slot_t& slot : slots_) {
+				if (slot.used) {
+					func(std::as_const(slot.key), slot.value);
+				}
+			}
+		}
+
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return size_;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return size_ == 0;
+		}
+
+		[[nodiscard]] size_t capacity() const noexcept
+		{
+			return slots_.size();
+		}
+
+		// Memory held by the slots
+		[[nodiscard]] size_t bytes() const noexcept
+		{
+			return slots_.capacity() * sizeof(slot_t);
+		}
+
+		// Memory the entries need at the maximum load, O(1)
+		[[nodiscard]] size_t live_bytes() const noexcept
+		{
+			return size_ * sizeof(slot_t) * MAX_LOAD_DEN / MAX_LOAD_NUM;
+		}
+
+	private:
+		struct slot_t
+		{
+			Key key{};
+			Value value{};
+			bool used{ false };
+		};
+
+		static constexpr size_t NPOS = ~size_t{};
+		static constexpr size_t MIN_CAPACITY = 16;
+		static constexpr size_t MAX_LOAD_NUM = 7;  // max load factor is 7/10
+		static constexpr size_t MAX_LOAD_DEN = 10;
+
+		std::vector<slot_t> slots_;
+		size_t mask_{ 0 };
+		size_t size_{ 0 };
+		[[no_unique_address]] Hash hash_{};
+
+		size_t home(const Key& key) const noexcept
+		{
+			return static_cast<size_t>(hash_(key)) & mask_;
+		}
+
+		size_t locate(const Key& key) const noexcept
+		{
+			if (size_ == 0) {
+				return NPOS;
+			}
+
+			for (size_t i = home(key);; i = (i + 1) & mask_) {
+				const slot_t& slot = slots_[i];
+				if (!slot.used) {
+					return NPOS;
+				}
+				if (slot.key == key) {
+					return i;
+				}
+			}
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<slot_t> old(capacity);
+			old.swap(slots_);
+			mask_ = capacity - 1;
+
+			for (slot_t& slot : old) {
+				if (!slot.used) {
+					continue;
+				}
+
+				size_t i = home(slot.key);
+				while (slots_[i].used) {
+					i = (i + 1) & mask_;
+				}
+				slots_[i] = std::move(slot);
+			}
+		}
+	};
+}
\ No newline at end of file
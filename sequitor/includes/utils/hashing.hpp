@@ -1,6 +1,8 @@
 #pragma once
 #include <functional>
 #include <utility>
+#include <type_traits>
+#include <cstdint>
 
 template<typename T>
 inline size_t hash_combine(size_t seed, const T& t)
@@ -20,4 +22,53 @@ namespace std
 			return hash_combine(hash_combine(0, p.first), p.second);
 		}
 	};
+}
+
+namespace pIOn::utils
+{
+	/**
+	* @brief murmur3 finalizer, every input bit affects every output bit
+	*/
+	[[nodiscard]] constexpr uint64_t mix64(uint64_t x) noexcept
+	{
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return x;
+	}
+
+	/**
+	* @brief folds a 128-bit key (two symbols) into 64 bits.
+	* Unlike hash_combine, a pair (a, b) and (b, a) or keys with small
+	* consecutive values do not land into neighbouring buckets.
+	*/
+	[[nodiscard]] constexpr uint64_t mix128to64(uint64_t lo, uint64_t hi) noexcept
+	{
+		const uint64_t a = lo * 0x9e3779b97f4a7c15ULL;
+		const uint64_t b = hi * 0xc2b2ae3d27d4eb4fULL;
+		return mix64(a ^ ((b << 31) | (b >> 33)));
+	}
+
+	// Hash for the flat containers, integral keys and pairs of them only
+	template<typename Key>
+	struct flat_hash
+	{
+		static_assert(std::is_integral_v<Key>, "flat_hash supports integral keys and their pairs!");
+
+		[[nodiscard]] uint64_t operator()(Key key) const noexcept
+		{
+			return mix64(static_cast<uint64_t>(key));
+		}
+	};
+
+	template<typename T, typename U>
+	struct flat_hash<std::pair<T, U>>
+	{
+		[[nodiscard]] uint64_t operator()(const std::pair<T, U>& key) const noexcept
+		{
+			return mix128to64(static_cast<uint64_t>(key.first), static_cast<uint64_t>(key.second));
+		}
+	};
 }
\ No newline at end of file
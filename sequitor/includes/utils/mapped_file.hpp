@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <utility>
+#include <memory>
+#include <cstddef>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pIOn::utils
+{
+	/**
+	* @brief Read-only memory mapping of a whole file. The pages are loaded by the OS
+	* on first access, so opening a big file costs nothing until it is read.
+	*/
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(std::string_view path)
+		{
+			const std::string name{ path };
+#ifdef _WIN32
+			HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				throw std::runtime_error{ "Cannot open the file = " + name };
+			}
+
+			LARGE_INTEGER size{};
+			GetFileSizeEx(file, &size);
+			size_ = static_cast<size_t>(size.QuadPart);
+			if (size_ != 0) {
+				HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping != nullptr) {
+					data_ = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+					CloseHandle(mapping);
+				}
+			}
+			CloseHandle(file);
+#else
+			const int fd = ::open(name.c_str(), O_RDONLY);
+			if (fd < 0) {
+				throw std::runtime_error{ "Cannot open the file = " + name };
+			}
+
+			struct stat st{};
+			if (::fstat(fd, &st) == 0) {
+				size_ = static_cast<size_t>(st.st_size);
+			}
+			if (size_ != 0) {
+				void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+				data_ = addr == MAP_FAILED ? nullptr : static_cast<const std::byte*>(addr);
+			}
+			::close(fd);
+#endif
+			if (size_ != 0 && data_ == nullptr) {
+				throw std::runtime_error{ "Cannot map the file = " + name };
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept
+		{
+			this->operator=(std::move(other));
+		}
+
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != std::addressof(other)) {
+				unmap();
+				data_ = std::exchange(other.data_, nullptr);
+				size_ = std::exchange(other.size_, 0);
+			}
+
+			return *this;
+		}
+
+		~MappedFile() noexcept
+		{
+			unmap();
+		}
+
+		[[nodiscard]] const std::byte* data() const noexcept
+		{
+			return data_;
+		}
+
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return size_;
+		}
+
+	private:
+		const std::byte* data_{ nullptr };
+		size_t size_{ 0 };
+
+		void unmap() noexcept
+		{
+			if (data_ == nullptr) {
+				return;
+			}
+#ifdef _WIN32
+			UnmapViewOfFile(data_);
+#else
+			::munmap(const_cast<std::byte*>(data_), size_);
+#endif
+			data_ = nullptr;
+		}
+	};
+}
\ No newline at end of file
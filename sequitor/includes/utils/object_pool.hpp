@@ -2,119 +2,215 @@
 #include <vector>
 #include <memory>
 #include <utility>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 namespace pIOn::utils
 {
-	template<typename T, size_t CHUNCK_SIZE = 100>
+	/**
+	* @brief Pool of objects of one type. A freed slot holds the pointer to the next free one,
+	* so the free list needs no memory of its own. Slots that have never been used are taken
+	* from the current chunk one after another, every new chunk is twice as big as the previous
+	* one up to MAX_CHUNK objects. With huge pages, chunks of 2 MB and more are mapped on
+	* transparent huge pages (Linux only, elsewhere the flag is ignored).
+	*/
+	template<typename T>
 	class ObjectPool
 	{
 	public:
-		ObjectPool() = default;
+		static constexpr size_t MIN_CHUNK = 64;
+		static constexpr size_t MAX_CHUNK = 1ULL << 16;
+		static constexpr size_t HUGE_PAGE = 2ULL << 20;
+
+		explicit ObjectPool(bool huge_pages = false) noexcept
+			: huge_pages_(huge_pages)
+		{}
+
 		ObjectPool(const ObjectPool&) = delete;
 		ObjectPool& operator=(const ObjectPool&) = delete;
 		ObjectPool(ObjectPool&&) = delete;
 		ObjectPool& operator=(ObjectPool&&) = delete;
 
+		~ObjectPool() noexcept
+		{
+			freeSpace();
+		}
+
 		template<typename... Args>
 		[[nodiscard]] T* allocate(Args&&... args)
 		{
-			T* obj = getRaw();
-			new (obj) T(std::forward<Args>(args)...);
-			return obj;
+			slot_t* slot = getRaw();
+			try {
+				T* obj = new (slot->storage) T(std::forward<Args>(args)...);
+				++size_;
+				return obj;
+			}
+			catch (...) {
+				slot->next = free_;
+				free_ = slot;
+				throw;
+			}
 		}
 
 		void deallocate(T* obj) noexcept
 		{
 			std::destroy_at(obj);
-			free_ptrs.push_back(obj);
+			slot_t* slot = reinterpret_cast<slot_t*>(obj);
+			slot->next = free_;
+			free_ = slot;
+			--size_;
+		}
+
+		/**
+		* @brief makes every slot free in O(1), the chunks stay for the next allocations.
+		* The objects are not destroyed, the caller destroys the ones that own resources.
+		*/
+		void reset() noexcept
+		{
+			free_ = nullptr;
+			chunk_ = 0;
+			used_ = 0;
+			size_ = 0;
 		}
 
+		// Gives the chunks back to the system, the objects are not destroyed
 		void freeSpace() noexcept
 		{
-			buffers.clear();
-			free_ptrs.clear();
+			for (const chunk_t& chunk : chunks_) {
+				release(chunk);
+			}
+			chunks_.clear();
+			reset();
 		}
 
-		~ObjectPool() noexcept
+		// Applies to the chunks allocated afterwards
+		void setHugePages(bool huge_pages) noexcept
 		{
-			freeSpace();
+			huge_pages_ = huge_pages;
 		}
-	private:
-		T* getRaw()
+
+		// Objects alive
+		[[nodiscard]] size_t size() const noexcept
 		{
-			if (free_ptrs.empty()) {
-				expandMem();
+			return size_;
+		}
+
+		// Slots in all chunks
+		[[nodiscard]] size_t capacity() const noexcept
+		{
+			size_t result = 0;
+			for (const chunk_t& chunk : chunks_) {
+				result += chunk.size;
 			}
+			return result;
+		}
 
-			T* obj = free_ptrs.back();
-			free_ptrs.pop_back();
-			return obj;
+		[[nodiscard]] size_t chunks() const noexcept
+		{
+			return chunks_.size();
 		}
 
-		class Buffer final
+		// Memory of the objects alive, O(1)
+		[[nodiscard]] size_t live_bytes() const noexcept
 		{
-		public:
-			Buffer() = delete;
-			Buffer(const Buffer&) = delete;
-			Buffer& operator=(const Buffer&) = delete;
+			return size_ * sizeof(slot_t);
+		}
 
-			// If there is not anought mem in the system then std::bad_alloc is a good
-			// for stoping the programm
-			Buffer(size_t num = CHUNCK_SIZE)
-				: buffer_((T*)(malloc(sizeof(T) * num)))
-				, size_(num)
-			{
+		// Memory held by the chunks, free slots included
+		[[nodiscard]] size_t bytes() const noexcept
+		{
+			size_t result = 0;
+			for (const chunk_t& chunk : chunks_) {
+				result += chunk.bytes;
 			}
+			return result;
+		}
 
-			Buffer(Buffer&& other) noexcept
-			{
-				this->operator=(std::move(other));
-			}
+	private:
+		union slot_t
+		{
+			slot_t* next;
+			alignas(T) std::byte storage[sizeof(T)];
+		};
 
-			Buffer& operator=(Buffer&& other) noexcept
-			{
-				if (this != std::addressof(other)) {
-					size_ = std::exchange(other.size_, 0);
-					buffer_ = std::exchange(other.buffer_, nullptr);
-				}
+		struct chunk_t
+		{
+			slot_t* slots{ nullptr };
+			size_t size{};
+			size_t bytes{};
+			bool mapped{ false };
+		};
 
-				return *this;
-			}
+		std::vector<chunk_t> chunks_;
+		slot_t* free_{ nullptr }; // intrusive list of the freed slots
+		size_t chunk_{ 0 };       // chunk the untouched slots are taken from
+		size_t used_{ 0 };        // slots of chunks_[chunk_] taken so far
+		size_t size_{ 0 };
+		bool huge_pages_{ false };
 
-			~Buffer() noexcept 
-			{
-				if (buffer_) {
-					free(buffer_);
-					buffer_ = nullptr;
-				}
+		slot_t* getRaw()
+		{
+			if (free_) {
+				return std::exchange(free_, free_->next);
 			}
 
-			size_t size() const noexcept
-			{
-				return size_;
+			while (chunk_ < chunks_.size() && used_ == chunks_[chunk_].size) {
+				++chunk_;
+				used_ = 0;
 			}
-
-			T* getBuffer() noexcept
-			{
-				return buffer_;
+			if (chunk_ == chunks_.size()) {
+				expandMem();
 			}
 
-		private:
-			T* buffer_{ nullptr };
-			size_t size_{};
-		};
-
-		std::vector<Buffer> buffers;
-		std::vector<T*> free_ptrs;
+			return &chunks_[chunk_].slots[used_++];
+		}
 
 		void expandMem()
 		{
-			buffers.emplace_back(CHUNCK_SIZE);
-			Buffer& buf = buffers.back();
+			chunk_t chunk;
+			chunk.size = chunks_.empty() ? MIN_CHUNK : std::min(chunks_.back().size * 2, MAX_CHUNK);
+			chunk.bytes = chunk.size * sizeof(slot_t);
+			chunks_.reserve(chunks_.size() + 1);
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			if (huge_pages_ && chunk.bytes >= HUGE_PAGE) {
+				chunk.bytes = (chunk.bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+				chunk.size = chunk.bytes / sizeof(slot_t);
+				void* ptr = mmap(nullptr, chunk.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (ptr != MAP_FAILED) {
+					madvise(ptr, chunk.bytes, MADV_HUGEPAGE); // a hint, the chunk works without it
+					chunk.slots = static_cast<slot_t*>(ptr);
+					chunk.mapped = true;
+				}
+			}
+#endif
+			if (!chunk.slots) {
+				chunk.bytes = chunk.size * sizeof(slot_t);
+				chunk.slots = static_cast<slot_t*>(std::malloc(chunk.bytes));
+				if (!chunk.slots) {
+					throw std::bad_alloc{};
+				}
+			}
 
-			for (size_t i = 0; i < buf.size(); ++i) {
-				free_ptrs.emplace_back(&buf.getBuffer()[i]);
+			chunks_.push_back(chunk);
+			chunk_ = chunks_.size() - 1;
+			used_ = 0;
+		}
+
+		static void release(const chunk_t& chunk) noexcept
+		{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			if (chunk.mapped) {
+				munmap(chunk.slots, chunk.bytes);
+				return;
 			}
+#endif
+			std::free(chunk.slots);
 		}
 	};
 }
\ No newline at end of file
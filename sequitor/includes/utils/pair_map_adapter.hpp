@@ -1,10 +1,23 @@
 #pragma once
-#include <map>
+#include <vector>
+#include <memory>
 #include <utility>
 #include <cstdint>
+#include <cstddef>
+
+#include "utils/hashing.hpp"
 
 namespace pIOn::utils
 {
+	/**
+	* @brief Values of the pairs of keys. The values live in chunks of CHUNK entries, one after another,
+	* and the index holds only their places and hashes, 8 bytes a slot, so the map costs less than a tree
+	* of the same pairs at any load. With a capacity set, a new pair over it takes the place of an old one
+	* in the CLOCK order: the hand goes around the entries, spares every one that has been updated since
+	* it passed last time and evicts the first one that has not. Only the updates through the mutable
+	* operator() count, so the const lookups stay free of writes.
+	* References returned by operator() are invalidated by the next insert of a new pair.
+	*/
 	template<typename Key, typename Value>
 	class PairMapAdapter
 	{
@@ -12,26 +25,118 @@ namespace pIOn::utils
 		using key_t = std::pair<Key, Key>;
 		using value_t = Value;
 
-		[[nodiscard]] value_t& operator()(const Key& i, const Key& j) noexcept;
+		static constexpr size_t CHUNK = 256;
+
+		[[nodiscard]] value_t& operator()(const Key& i, const Key& j);
 		[[nodiscard]] const value_t& operator()(const Key& i, const Key& j) const noexcept;
 		[[nodiscard]] bool contains(const Key& i, const Key& j) const noexcept;
 		void clear() noexcept;
+		[[nodiscard]] size_t size() const noexcept;
+
+		// Pairs kept at most, 0 - no bound. The pairs over a smaller capacity are evicted at once.
+		void setCapacity(size_t capacity);
+		[[nodiscard]] size_t getCapacity() const noexcept;
+		[[nodiscard]] uint64_t evictions() const noexcept;
+
+		// Memory held by the index, the chunks and the marks
+		[[nodiscard]] size_t bytes() const noexcept;
+
+		template<typename F>
+		void for_each(F&& func) const
+		{
+			for (size_t i = 0; i < size_; ++i) {
+				const entry_t& entry = at(i);
+				func(entry.key.first, entry.key.second, entry.value);
+			}
+		}
 	private:
-		std::map<key_t, value_t> container_;
+		struct entry_t
+		{
+			key_t key{};
+			Value value{};
+		};
+
+		struct slot_t
+		{
+			uint32_t place{ 0 }; // of the entry + 1, 0 - empty
+			uint32_t hash{ 0 };  // low bits of the hash, the home of the slot
+		};
+
+		static constexpr size_t NPOS = ~size_t{};
+		static constexpr size_t MIN_SLOTS = 16;
+		static constexpr size_t MAX_LOAD_NUM = 7; // max load factor of the index is 7/10, as of FlatMap
+		static constexpr size_t MAX_LOAD_DEN = 10;
+
+		entry_t& at(size_t i) noexcept { return chunks_[i / CHUNK][i % CHUNK]; }
+		const entry_t& at(size_t i) const noexcept { return chunks_[i / CHUNK][i % CHUNK]; }
+
+		static uint32_t hash(const key_t& key) noexcept
+		{
+			return static_cast<uint32_t>(flat_hash<key_t>{}(key));
+		}
+		// Slot of the key, or the empty one where it would go
+		size_t locate(const key_t& key) const noexcept;
+		void rehash(size_t slots);
+		void eraseSlot(size_t i) noexcept;
+
+		// Evicts the entry under the hand that has not been updated, returns its place
+		size_t evict();
+		// Moves the last entry to the place of an evicted one
+		void fill(size_t freed);
+
+		std::vector<slot_t> index_;
+		size_t mask_{ 0 };
+		std::vector<std::unique_ptr<entry_t[]>> chunks_;
+		std::vector<bool> referenced_; // by place, updated since the hand passed it
+		size_t size_{ 0 };
+		size_t hand_{ 0 };
+		size_t capacity_{ 0 };
+		uint64_t evictions_{ 0 };
 	};
 
 	// Implementation
 	template<typename Key, typename Value>
-	inline Value& PairMapAdapter<Key, Value>::operator()(const Key& i, const Key& j) noexcept
+	inline Value& PairMapAdapter<Key, Value>::operator()(const Key& i, const Key& j)
 	{
-		return container_[key_t(i, j)];
+		const key_t key(i, j);
+		if (size_t slot = locate(key); slot != NPOS && index_[slot].place != 0) {
+			const size_t place = index_[slot].place - 1;
+			if (capacity_ != 0) {
+				referenced_[place] = true;
+			}
+			return at(place).value;
+		}
+
+		// the eviction goes first, it moves the slots of the index
+		size_t place = size_;
+		if (capacity_ != 0 && size_ >= capacity_) {
+			place = evict();
+		}
+		else {
+			if ((size_ + 1) * MAX_LOAD_DEN > index_.size() * MAX_LOAD_NUM) {
+				rehash(index_.empty() ? MIN_SLOTS : index_.size() * 2);
+			}
+			if (size_ == chunks_.size() * CHUNK) {
+				chunks_.push_back(std::make_unique<entry_t[]>(CHUNK));
+			}
+			referenced_.push_back(false);
+			++size_;
+		}
+
+		// a new pair is not marked, so the pairs seen once leave at the first visit of the hand
+		index_[locate(key)] = { static_cast<uint32_t>(place + 1), hash(key) };
+		referenced_[place] = false;
+		entry_t& entry = at(place);
+		entry = entry_t{ key };
+		return entry.value;
 	}
 	template<typename Key, typename Value>
 	const Value& PairMapAdapter<Key, Value>::operator()(const Key& i, const Key& j) const noexcept
 	{
 		static const Value raw_value{};
-		if (auto it = container_.find(key_t(i, j)); it != container_.cend()) {
-			return it->second;
+		const size_t slot = locate(key_t(i, j));
+		if (slot != NPOS && index_[slot].place != 0) {
+			return at(index_[slot].place - 1).value;
 		}
 		else {
 			return raw_value;
@@ -40,12 +145,139 @@ namespace pIOn::utils
 	template<typename Key, typename Value>
 	inline bool PairMapAdapter<Key, Value>::contains(const Key& i, const Key& j) const noexcept
 	{
-		return container_.contains(key_t(i, j));
+		const size_t slot = locate(key_t(i, j));
+		return slot != NPOS && index_[slot].place != 0;
 	}
 
 	template<typename Key, typename Value>
 	inline void PairMapAdapter<Key, Value>::clear() noexcept
 	{
-		container_.clear();
+		// the memory is released
+		index_ = std::vector<slot_t>{};
+		mask_ = 0;
+		chunks_ = std::vector<std::unique_ptr<entry_t[]>>{};
+		referenced_ = std::vector<bool>{};
+		size_ = 0;
+		hand_ = 0;
+	}
+
+	template<typename Key, typename Value>
+	inline size_t PairMapAdapter<Key, Value>::size() const noexcept
+	{
+		return size_;
+	}
+
+	template<typename Key, typename Value>
+	void PairMapAdapter<Key, Value>::setCapacity(size_t capacity)
+	{
+		capacity_ = capacity;
+		hand_ = 0;
+		if (capacity_ == 0) {
+			return;
+		}
+
+		while (size_ > capacity_) {
+			fill(evict());
+		}
+		chunks_.resize((size_ + CHUNK - 1) / CHUNK);
+		referenced_.resize(size_);
+	}
+
+	template<typename Key, typename Value>
+	inline size_t PairMapAdapter<Key, Value>::getCapacity() const noexcept
+	{
+		return capacity_;
+	}
+
+	template<typename Key, typename Value>
+	inline uint64_t PairMapAdapter<Key, Value>::evictions() const noexcept
+	{
+		return evictions_;
+	}
+
+	template<typename Key, typename Value>
+	inline size_t PairMapAdapter<Key, Value>::bytes() const noexcept
+	{
+		return index_.capacity() * sizeof(slot_t) + chunks_.size() * CHUNK * sizeof(entry_t)
+			+ chunks_.capacity() * sizeof(chunks_[0]) + referenced_.capacity() / 8;
+	}
+
+	template<typename Key, typename Value>
+	size_t PairMapAdapter<Key, Value>::locate(const key_t& key) const noexcept
+	{
+		if (index_.empty()) {
+			return NPOS;
+		}
+
+		const uint32_t h = hash(key);
+		for (size_t i = h & mask_;; i = (i + 1) & mask_) {
+			const slot_t& slot = index_[i];
+			if (slot.place == 0 || (slot.hash == h && at(slot.place - 1).key == key)) {
+				return i;
+			}
+		}
+	}
+
+	template<typename Key, typename Value>
+	void PairMapAdapter<Key, Value>::rehash(size_t slots)
+	{
+		std::vector<slot_t> old = std::exchange(index_, std::vector<slot_t>(slots));
+		mask_ = slots - 1;
+		for (const slot_t& slot : old) {
+			if (slot.place != 0) {
+				size_t i = slot.hash & mask_;
+				while (index_[i].place != 0) {
+					i = (i + 1) & mask_;
+				}
+				index_[i] = slot;
+			}
+		}
+	}
+
+	template<typename Key, typename Value>
+	void PairMapAdapter<Key, Value>::eraseSlot(size_t i) noexcept
+	{
+		// backward shift: pull up every following slot whose probe path crosses the hole, as FlatMap::erase
+		for (size_t j = (i + 1) & mask_; index_[j].place != 0; j = (j + 1) & mask_) {
+			const size_t h = index_[j].hash & mask_;
+			if (((j - h) & mask_) >= ((j - i) & mask_)) {
+				index_[i] = index_[j];
+				i = j;
+			}
+		}
+
+		index_[i] = slot_t{};
+	}
+
+	template<typename Key, typename Value>
+	size_t PairMapAdapter<Key, Value>::evict()
+	{
+		// every referenced pair loses its mark, so the hand stops within one turn
+		for (;; hand_ = (hand_ + 1) % size_) {
+			if (referenced_[hand_]) {
+				referenced_[hand_] = false;
+				continue;
+			}
+
+			eraseSlot(locate(at(hand_).key));
+			++evictions_;
+			const size_t freed = hand_;
+			hand_ = (hand_ + 1) % size_;
+			return freed;
+		}
+	}
+
+	template<typename Key, typename Value>
+	void PairMapAdapter<Key, Value>::fill(size_t freed)
+	{
+		--size_;
+		if (freed != size_) {
+			at(freed) = std::move(at(size_));
+			referenced_[freed] = referenced_[size_];
+			index_[locate(at(freed).key)].place = static_cast<uint32_t>(freed + 1);
+		}
+
+		// the last entry has not been visited yet, so the hand goes back to its new place
+		hand_ = freed < size_ ? freed : 0;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace pIOn::utils
+{
+	/**
+	* @brief Single writer, many readers cell. The writer fills a spare copy of T and
+	* publishes it by swapping the index of the current copy, readers pin the current copy
+	* and read it in place while the writer moves on.
+	*
+	* The index of the current copy and the number of readers that pinned it are packed
+	* in one word, so pinning is a single fetch_add and never waits. When a copy is replaced,
+	* the writer moves its reader count to the copy, the last reader to leave frees it.
+	* The writer never waits either: if all spare copies are still pinned, the publication
+	* is skipped and readers keep seeing the previous value.
+	*/
+	template<typename T, size_t N = 8>
+	class Published
+	{
+		static_assert(N >= 2 && N <= 256, "Published needs from 2 to 256 copies!");
+	public:
+		class reader_t
+		{
+		public:
+			reader_t(const reader_t&) = delete;
+			reader_t& operator=(const reader_t&) = delete;
+
+			reader_t(reader_t&& other) noexcept
+				: parent_(std::exchange(other.parent_, nullptr))
+				, idx_(other.idx_)
+			{}
+
+			reader_t& operator=(reader_t&&) = delete;
+
+			~reader_t() noexcept
+			{
+				if (parent_) {
+					parent_->slots_[idx_].readers.fetch_sub(1, std::memory_order_release);
+				}
+			}
+
+			const T& operator*() const noexcept { return parent_->slots_[idx_].value; }
+			const T* operator->() const noexcept { return &parent_->slots_[idx_].value; }
+
+			// Number of the publication, 0 before the first one
+			uint64_t version() const noexcept { return parent_->slots_[idx_].version; }
+
+		private:
+			friend class Published;
+			reader_t(const Published* parent, size_t idx) noexcept : parent_(parent), idx_(idx) {}
+
+			const Published* parent_;
+			size_t idx_;
+		};
+
+		Published() = default;
+		Published(const Published&) = delete;
+		Published& operator=(const Published&) = delete;
+
+		// Wait-free, the value stays valid and unchanged while the reader lives
+		[[nodiscard]] reader_t read() const noexcept
+		{
+			const uint64_t state = state_.fetch_add(READER, std::memory_order_acq_rel);
+			return reader_t{ this, static_cast<size_t>(state & INDEX_MASK) };
+		}
+
+		/**
+		* @brief calls fill(T&) on a spare copy and makes it current. The copy holds a value
+		* of some older publication, so fill may reuse its memory. Must not be called concurrently.
+		*
+		* @return false if every spare copy is still read, nothing is published then
+		*/
+		template<typename F>
+		bool publish(F&& fill)
+		{
+			const size_t current = static_cast<size_t>(state_.load(std::memory_order_relaxed) & INDEX_MASK);
+			size_t spare = N;
+			for (size_t i = 0; i < N; ++i) {
+				if (i != current && slots_[i].readers.load(std::memory_order_acquire) == 0) {
+					spare = i;
+					break;
+				}
+			}
+			if (spare == N) {
+				return false;
+			}
+
+			slot_t& slot = slots_[spare];
+			fill(slot.value);
+			slot.version = ++version_;
+
+			const uint64_t old = state_.exchange(spare, std::memory_order_acq_rel);
+			slots_[old & INDEX_MASK].readers.fetch_add(static_cast<int64_t>(old >> INDEX_BITS), std::memory_order_acq_rel);
+			return true;
+		}
+
+		// Number of publications, the writer side
+		[[nodiscard]] uint64_t version() const noexcept
+		{
+			return version_;
+		}
+
+	private:
+		static constexpr uint64_t INDEX_BITS = 8;
+		static constexpr uint64_t INDEX_MASK = (1ULL << INDEX_BITS) - 1;
+		static constexpr uint64_t READER = 1ULL << INDEX_BITS;
+
+		struct slot_t
+		{
+			// Readers that pinned it minus readers that left, the pinned ones are added when it stops being current
+			mutable std::atomic<int64_t> readers{ 0 };
+			T value{};
+			uint64_t version{ 0 };
+		};
+
+		std::array<slot_t, N> slots_{};
+		mutable std::atomic<uint64_t> state_{ 0 }; // readers of the current copy << INDEX_BITS | its index
+		uint64_t version_{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace pIOn::utils
+{
+	/**
+	* @brief Sorted flat set that keeps up to N elements inline and spills to the heap
+	* only when it grows beyond that. Iteration order is the same as in std::set, but
+	* iterators are plain pointers and are invalidated by any insert or erase.
+	*/
+	template<typename T, size_t N = 3, typename Compare = std::less<T>>
+	class SmallFlatSet
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "SmallFlatSet holds trivially copyable types only!");
+		static_assert(N > 0, "Inline capacity of SmallFlatSet must be positive!");
+	public:
+		using value_type = T;
+		using size_type = size_t;
+		using iterator = T*;
+		using const_iterator = const T*;
+
+		SmallFlatSet() noexcept {}
+
+		SmallFlatSet(const SmallFlatSet& other)
+		{
+			assign(other.begin(), other.end());
+		}
+
+		SmallFlatSet(SmallFlatSet&& other) noexcept
+		{
+			steal(other);
+		}
+
+		SmallFlatSet& operator=(const SmallFlatSet& other)
+		{
+			if (this != std::addressof(other)) {
+				assign(other.begin(), other.end());
+			}
+
+			return *this;
+		}
+
+		SmallFlatSet& operator=(SmallFlatSet&& other) noexcept
+		{
+			if (this != std::addressof(other)) {
+				release();
+				steal(other);
+			}
+
+			return *this;
+		}
+
+		~SmallFlatSet() noexcept
+		{
+			release();
+		}
+
+		std::pair<iterator, bool> insert(const T& value)
+		{
+			T* pos = lower_bound(value);
+			if (pos != end() && !comp_(value, *pos)) {
+				return { pos, false };
+			}
+
+			const size_t idx = static_cast<size_t>(pos - begin());
+			if (size_ == capacity_) {
+				grow(capacity_ * 2);
+			}
+
+			T* first = data();
+			std::move_backward(first + idx, first + size_, first + size_ + 1);
+			first[idx] = value;
+			++size_;
+
+			return { first + idx, true };
+		}
+
+		template<typename InputIt>
+		void insert(InputIt first, InputIt last)
+		{
+			for (; first != last; ++first) {
+				insert(*first);
+			}
+		}
+
+		size_type erase(const T& value) noexcept
+		{
+			T* pos = lower_bound(value);
+			if (pos == end() || comp_(value, *pos)) {
+				return 0;
+			}
+
+			std::move(pos + 1, end(), pos);
+			--size_;
+			return 1;
+		}
+
+		[[nodiscard]] bool contains(const T& value) const noexcept
+		{
+			const T* pos = lower_bound(value);
+			return pos != end() && !comp_(value, *pos);
+		}
+
+		// Keeps the heap buffer, if any, for the next inserts
+		void clear() noexcept
+		{
+			size_ = 0;
+		}
+
+		[[nodiscard]] size_type size() const noexcept
+		{
+			return size_;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return size_ == 0;
+		}
+
+		[[nodiscard]] size_type capacity() const noexcept
+		{
+			return capacity_;
+		}
+
+		[[nodiscard]] bool is_inline() const noexcept
+		{
+			return capacity_ == N;
+		}
+
+		// Memory allocated outside of the set, none while the elements are inline
+		[[nodiscard]] size_t heap_bytes() const noexcept
+		{
+			return is_inline() ? 0 : capacity_ * sizeof(T);
+		}
+
+		iterator begin() noexcept { return data(); }
+		iterator end() noexcept { return data() + size_; }
+		const_iterator begin() const noexcept { return data(); }
+		const_iterator end() const noexcept { return data() + size_; }
+		const_iterator cbegin() const noexcept { return data(); }
+		const_iterator cend() const noexcept { return data() + size_; }
+
+	private:
+		uint32_t size_{ 0 };
+		uint32_t capacity_{ N };
+		union
+		{
+			T inline_[N];
+			T* heap_;
+		};
+		[[no_unique_address]] Compare comp_{};
+
+		T* data() noexcept
+		{
+			return is_inline() ? inline_ : heap_;
+		}
+
+		const T* data() const noexcept
+		{
+			return is_inline() ? inline_ : heap_;
+		}
+
+		T* lower_bound(const T& value) noexcept
+		{
+			return std::lower_bound(begin(), end(), value, comp_);
+		}
+
+		const T* lower_bound(const T& value) const noexcept
+		{
+			return std::lower_bound(begin(), end(), value, comp_);
+		}
+
+		void grow(size_t capacity)
+		{
+			T* buffer = new T[capacity];
+			std::copy(begin(), end(), buffer);
+			release();
+			heap_ = buffer;
+			capacity_ = static_cast<uint32_t>(capacity);
+		}
+
+		template<typename InputIt>
+		void assign(InputIt first, InputIt last)
+		{
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			size_ = 0;
+			if (count > capacity_) {
+				grow(count);
+			}
+
+			std::copy(first, last, data());
+			size_ = static_cast<uint32_t>(count);
+		}
+
+		void release() noexcept
+		{
+			if (!is_inline()) {
+				delete[] heap_;
+				capacity_ = N;
+			}
+		}
+
+		void steal(SmallFlatSet& other) noexcept
+		{
+			size_ = std::exchange(other.size_, 0);
+			capacity_ = std::exchange(other.capacity_, static_cast<uint32_t>(N));
+			if (is_inline()) {
+				std::copy(other.inline_, other.inline_ + size_, inline_);
+			}
+			else {
+				heap_ = other.heap_;
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+#include <ostream>
+#include <span>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace pIOn::utils
+{
+	// Every value and array of a snapshot starts at a multiple of its alignment (at most 8),
+	// so arrays can be used in place from a mapped file
+	inline constexpr size_t SNAPSHOT_ALIGN = 8;
+
+	/**
+	* @brief Writes trivially copyable values and arrays of them in the native byte order
+	*/
+	class SnapshotWriter
+	{
+	public:
+		explicit SnapshotWriter(std::ostream& stream) noexcept
+			: stream_(stream)
+		{}
+
+		template<typename T>
+		void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SNAPSHOT_ALIGN, "Snapshot stores plain values only!");
+			align(alignof(T));
+			raw(&value, sizeof(T));
+		}
+
+		template<typename T>
+		void write_array(const T* data, size_t count)
+		{
+			static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SNAPSHOT_ALIGN, "Snapshot stores plain values only!");
+			write<uint64_t>(count);
+			align(SNAPSHOT_ALIGN);
+			raw(data, sizeof(T) * count);
+		}
+
+		template<typename T>
+		void write_array(const std::vector<T>& values)
+		{
+			write_array(values.data(), values.size());
+		}
+
+		[[nodiscard]] bool good() const
+		{
+			return stream_.good();
+		}
+
+	private:
+		std::ostream& stream_;
+		size_t offset_{ 0 };
+
+		void align(size_t alignment)
+		{
+			static constexpr char zeros[SNAPSHOT_ALIGN]{};
+			raw(zeros, (alignment - offset_ % alignment) % alignment);
+		}
+
+		void raw(const void* data, size_t size)
+		{
+			stream_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			offset_ += size;
+		}
+	};
+
+	/**
+	* @brief Reads what SnapshotWriter has written. Arrays are not copied, they point into
+	* the given memory, which has to be aligned to SNAPSHOT_ALIGN and outlive them.
+	* Throws std::runtime_error if the data ends too early.
+	*/
+	class SnapshotReader
+	{
+	public:
+		SnapshotReader(const std::byte* data, size_t size) noexcept
+			: data_(data)
+			, size_(size)
+		{}
+
+		template<typename T>
+		T read()
+		{
+			static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SNAPSHOT_ALIGN, "Snapshot stores plain values only!");
+			align(alignof(T));
+			T value;
+			std::memcpy(&value, take(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		std::span<const T> read_array()
+		{
+			static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SNAPSHOT_ALIGN, "Snapshot stores plain values only!");
+			const uint64_t count = read<uint64_t>();
+			align(SNAPSHOT_ALIGN);
+			if (count > (size_ - offset_) / sizeof(T)) {
+				throw std::runtime_error{ "Snapshot is truncated!" };
+			}
+
+			return { reinterpret_cast<const T*>(take(sizeof(T) * count)), static_cast<size_t>(count) };
+		}
+
+		[[nodiscard]] bool eof() const noexcept
+		{
+			return offset_ == size_;
+		}
+
+	private:
+		const std::byte* data_;
+		size_t size_;
+		size_t offset_{ 0 };
+
+		void align(size_t alignment)
+		{
+			take((alignment - offset_ % alignment) % alignment);
+		}
+
+		const std::byte* take(size_t size)
+		{
+			if (size > size_ - offset_) {
+				throw std::runtime_error{ "Snapshot is truncated!" };
+			}
+
+			const std::byte* result = data_ + offset_;
+			offset_ += size;
+			return result;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,1098 @@
+/******************************************************************************
+ This file contains portions of code originating from C. Nevill-Manning's
+ Sequitur (http://www.sequitur.info/sequitur_simple.cc) under the terms and
+ conditions of the Apache 2.0 License, which can be found at
+ https://www.apache.org/licenses/LICENSE-2.0
+*******************************************************************************/
+
+#include <cassert>
+#include <algorithm>
+#include "compact_predictor.hpp"
+
+// The algorithm is a line by line port of Symbols/Rules/Predictor, see symbols.cpp
+// for the description of every step. Allocation order is kept the same, so both
+// implementations build identical grammars.
+
+namespace pIOn::sequitur {
+
+	CompactPredictor::CompactPredictor()
+	{
+		init();
+	}
+
+	void CompactPredictor::init()
+	{
+		// slot 0 is NIL
+		links_.assign(1, link_t{});
+		states_.assign(1, predictor_state_t{});
+		occurrences_.assign(1, occurrence_t{});
+		rules_.assign(1, rule_t{});
+		free_symbols_.clear();
+		free_rules_.clear();
+		symbols_count_ = 0;
+
+		axiom_ = allocate_rule();
+		root_ = allocate_nt(axiom_, NIL);
+	}
+
+	CompactPredictor::handle_t CompactPredictor::allocate_symbol(uint64_t sym, handle_t owner)
+	{
+		handle_t s{};
+		if (free_symbols_.empty()) {
+			assert(links_.size() < ~handle_t{} && "grammar does not fit into 32-bit handles");
+			s = static_cast<handle_t>(links_.size());
+			links_.emplace_back();
+			states_.emplace_back();
+			occurrences_.emplace_back();
+		}
+		else {
+			s = free_symbols_.back();
+			free_symbols_.pop_back();
+		}
+
+		links_[s] = link_t{ sym, NIL, NIL, owner, TERMINAL };
+		occurrences_[s] = occurrence_t{};
+		return s;
+	}
+
+	CompactPredictor::handle_t CompactPredictor::allocate_nt(handle_t rule, handle_t owner)
+	{
+		handle_t s = allocate_symbol(rule, owner);
+		links_[s].flags = 0;
+		rules_[rule].users.insert(s);
+		return s;
+	}
+
+	CompactPredictor::handle_t CompactPredictor::allocate_rule()
+	{
+		handle_t r{};
+		if (free_rules_.empty()) {
+			r = static_cast<handle_t>(rules_.size());
+			rules_.emplace_back();
+		}
+		else {
+			r = free_rules_.back();
+			free_rules_.pop_back();
+		}
+
+		rules_[r].alive = true;
+		rules_[r].idx = 0;
+		rules_[r].length = 0;
+
+		// the guard is not a user of its own rule
+		handle_t guard = allocate_symbol(r, r);
+		links_[guard].flags = 0;
+		rules_[r].guard = guard;
+		links_[guard].next = links_[guard].prev = guard;
+
+		return r;
+	}
+
+	void CompactPredictor::free_symbol(handle_t s)
+	{
+		predictor_state_t& state = states_[s];
+		state.predictors.clear();
+		state.next_new_predictor.clear();
+		state.next_stay_predictor.clear();
+		state.next_is_predictor = state.next_updated = false;
+		state.next_return = 0;
+		free_symbols_.push_back(s);
+	}
+
+	void CompactPredictor::free_rule(handle_t r)
+	{
+		const handle_t guard = rules_[r].guard;
+		release(guard);
+		free_symbol(guard);
+
+		rules_[r].alive = false;
+		rules_[r].users.clear();
+		free_rules_.push_back(r);
+	}
+
+	void CompactPredictor::set_pred(handle_t s, bool is_pred) noexcept
+	{
+		if (is_pred) {
+			links_[s].flags |= PREDICTOR;
+		}
+		else {
+			links_[s].flags &= ~PREDICTOR;
+		}
+	}
+
+	void CompactPredictor::resize(handle_t r, int64_t delta) noexcept
+	{
+		rules_[r].length += static_cast<int32_t>(delta);
+		symbols_count_ += delta;
+	}
+
+	CompactPredictor::handle_t CompactPredictor::find_digram(handle_t s) const noexcept
+	{
+		return index_.find(key(s), key(next(s)));
+	}
+
+	void CompactPredictor::delete_digram(handle_t s) noexcept
+	{
+		if (is_guard(s) || is_guard(next(s)) || owner(s) == NIL) {
+			return;
+		}
+
+		index_.erase(key(s), key(next(s)), s);
+	}
+
+	void CompactPredictor::set_digram(handle_t s)
+	{
+		if (is_guard(s) || is_guard(next(s)) || owner(s) == NIL) {
+			return;
+		}
+
+		index_.assign(key(s), key(next(s)), s);
+	}
+
+	void CompactPredictor::link_occurrence(handle_t s)
+	{
+		handle_t& head = occurrence_heads_[key(s)];
+		occurrences_[s] = occurrence_t{ head, NIL };
+		if (head != NIL) {
+			occurrences_[head].prev = s;
+		}
+		head = s;
+	}
+
+	void CompactPredictor::unlink_occurrence(handle_t s) noexcept
+	{
+		occurrence_t& occ = occurrences_[s];
+		if (occ.prev != NIL) {
+			occurrences_[occ.prev].next = occ.next;
+		}
+		else {
+			handle_t* head = occurrence_heads_.find(key(s));
+			if (head == nullptr || *head != s) {
+				return; // not linked
+			}
+
+			if (occ.next != NIL) {
+				*head = occ.next;
+			}
+			else {
+				occurrence_heads_.erase(key(s));
+			}
+		}
+
+		if (occ.next != NIL) {
+			occurrences_[occ.next].prev = occ.prev;
+		}
+		occ = occurrence_t{};
+	}
+
+	void CompactPredictor::join(handle_t left, handle_t right)
+	{
+		if (next(left) != NIL && !is_guard(left)) {
+			delete_digram(left);
+
+			// triples, see Symbols::join
+			const handle_t rp = prev(right), rn = next(right);
+			if (rp != NIL && rn != NIL && key(right) == key(rp) && key(right) == key(rn)) {
+				set_digram(right);
+			}
+
+			const handle_t lp = prev(left), ln = next(left);
+			if (lp != NIL && ln != NIL && key(left) == key(ln) && key(left) == key(lp)) {
+				set_digram(lp);
+			}
+		}
+
+		links_[right].owner = links_[left].owner;
+		links_[left].next = right;
+		links_[right].prev = left;
+	}
+
+	void CompactPredictor::insert_after(handle_t s, handle_t y)
+	{
+		join(y, next(s));
+		join(s, y);
+		resize(owner(s), 1);
+		link_occurrence(y);
+	}
+
+	CompactPredictor::handle_t CompactPredictor::release(handle_t s)
+	{
+		if (prev(s) == NIL && next(s) == NIL) {
+			return s;
+		}
+
+		join(prev(s), next(s));
+
+		if (!is_guard(s)) {
+			resize(owner(s), -1);
+			unlink_occurrence(s);
+			delete_digram(s);
+			if (nt(s)) {
+				rules_[rule(s)].users.erase(s);
+			}
+		}
+
+		if (is_pred(s) && !nt(s) && owner(s) != NIL) {
+			remove_prediction(s);
+		}
+
+		return s;
+	}
+
+	void CompactPredictor::expand(handle_t s)
+	{
+		const handle_t left = prev(s);
+		const handle_t right = next(s);
+		const handle_t r = rule(s);
+		const handle_t f = first(r);
+		const handle_t l = last(r);
+		const handle_t o = owner(s);
+
+		if (is_pred(s)) {
+			for (handle_t user : rules_[o].users) {
+				if (states_[user].predictors.erase(s)) {
+					states_[user].predictors.insert(states_[s].predictors.begin(), states_[s].predictors.end());
+				}
+			}
+		}
+
+		for (handle_t ns = f; ns != l; ns = next(ns)) {
+			links_[ns].owner = o;
+		}
+		links_[l].owner = o;
+
+		// symbols move to the owner, the grammar total does not change
+		rules_[o].length += rules_[r].length;
+
+		delete_digram(s);
+		unlink_occurrence(s);
+
+		free_rule(r);
+		links_[s].sym = 0;
+		free_symbol(release(s));
+
+		join(left, f);
+		join(l, right);
+
+		set_digram(l);
+	}
+
+	void CompactPredictor::substitute(handle_t x1, handle_t r)
+	{
+		const handle_t q = prev(x1);
+
+		const handle_t b = allocate_nt(r, owner(x1));
+		const handle_t x2 = first(r);
+		const handle_t y1 = next(x1);
+		const handle_t y2 = next(x2);
+		const handle_t o = owner(x1);
+
+		auto s_update = [this, b, o](handle_t x1, handle_t x2)
+		{
+			set_pred(b, true);
+			for (handle_t user : rules_[o].users) {
+				if (states_[user].predictors.erase(x1)) {
+					states_[user].predictors.insert(b);
+				}
+			}
+
+			states_[x2].predictors.insert(states_[x1].predictors.begin(), states_[x1].predictors.end());
+			set_pred(x2, true);
+			if (!nt(x2)) {
+				add_prediction(x2);
+			}
+			states_[b].predictors.insert(x2);
+		};
+
+		if (is_pred(x1)) {
+			s_update(x1, x2);
+		}
+
+		if (is_pred(y1)) {
+			s_update(y1, y2);
+		}
+
+		free_symbol(release(x1));
+		free_symbol(release(y1));
+
+		insert_after(q, b);
+
+		if (!check(q)) {
+			check(next(q));
+		}
+	}
+
+	void CompactPredictor::match(handle_t ss, handle_t m)
+	{
+		handle_t r{ NIL };
+
+		if (is_guard(prev(m)) && is_guard(next(next(m)))) {
+			r = rule(prev(m));
+			substitute(ss, r);
+		}
+		else {
+			r = allocate_rule();
+
+			const handle_t a = nt(ss) ? allocate_nt(rule(ss), r) : allocate_symbol(links_[ss].sym, r);
+			insert_after(last(r), a);
+
+			const handle_t sn = next(ss);
+			const handle_t b = nt(sn) ? allocate_nt(rule(sn), r) : allocate_symbol(links_[sn].sym, r);
+			insert_after(last(r), b);
+
+			substitute(m, r);
+			substitute(ss, r);
+
+			set_digram(first(r));
+		}
+
+		if (nt(first(r)) && rules_[rule(first(r))].users.size() == 1) {
+			expand(first(r));
+		}
+	}
+
+	bool CompactPredictor::check(handle_t s)
+	{
+		if (is_guard(s) || is_guard(next(s))) {
+			return false;
+		}
+
+		const handle_t x = find_digram(s);
+		if (x == NIL) {
+			set_digram(s);
+			return false;
+		}
+
+		if (next(x) != s) {
+			match(s, x);
+		}
+
+		return true;
+	}
+
+	void CompactPredictor::become_predictor_down_left(handle_t s)
+	{
+		set_pred(s, true);
+
+		handle_t sym_ptr = s;
+		LOOP
+		{
+			if (nt(sym_ptr))
+			{
+				states_[sym_ptr].predictors.insert(first(rule(sym_ptr)));
+				sym_ptr = first(rule(sym_ptr));
+				set_pred(sym_ptr, true);
+			}
+			else
+			{
+				add_prediction(sym_ptr);
+				break;
+			}
+		}
+	}
+
+	void CompactPredictor::become_predictor_down_right(handle_t s)
+	{
+		set_pred(s, true);
+
+		handle_t sym_ptr = s;
+		LOOP
+		{
+			if (nt(sym_ptr))
+			{
+				states_[sym_ptr].predictors.insert(last(rule(sym_ptr)));
+				sym_ptr = last(rule(sym_ptr));
+				set_pred(sym_ptr, true);
+			}
+			else
+			{
+				add_prediction(sym_ptr);
+				break;
+			}
+		}
+	}
+
+	void CompactPredictor::become_predictor_up(handle_t user, handle_t child)
+	{
+		std::stack<std::pair<handle_t, handle_t>> stack;
+		stack.emplace(user, child);
+
+		while (!stack.empty())
+		{
+			auto [u, c] = stack.top(); stack.pop();
+
+			if (!states_[u].predictors.insert(c).second) {
+				continue;
+			}
+
+			set_pred(u, true);
+
+			if (owner(u) == NIL) {
+				continue;
+			}
+
+			for (handle_t next_user : rules_[owner(u)].users) {
+				stack.emplace(next_user, u);
+			}
+		}
+	}
+
+	void CompactPredictor::process_matching(handle_t s, handle_t matching)
+	{
+		// children never touch the predictors of their parent, iteration is safe
+		for (handle_t p : states_[s].predictors) {
+			predictor_state_t& state = states_[s];
+			switch (compute_next_predictors(p, matching)) {
+			case 0:
+				break;
+			case 1:
+				state.next_stay_predictor.insert(p);
+				state.next_return |= 1;
+				break;
+			case 2:
+				if (is_guard(next(p))) {
+					state.next_return |= 2;
+				}
+				else {
+					state.next_new_predictor.insert(next(p));
+					state.next_return |= 1;
+				}
+				break;
+			case 3:
+				state.next_return |= 1;
+				state.next_stay_predictor.insert(p);
+				if (!is_guard(next(p))) {
+					state.next_new_predictor.insert(next(p));
+				}
+				else {
+					state.next_return |= 2;
+				}
+				break;
+			}
+		}
+
+		predictor_state_t& state = states_[s];
+		if (state.next_stay_predictor.empty() && state.next_new_predictor.empty()) {
+			state.next_is_predictor = false;
+		}
+	}
+
+	uint8_t CompactPredictor::compute_next_predictors(handle_t s, handle_t matching)
+	{
+		predictor_state_t& state = states_[s];
+		if (state.next_updated) {
+			return state.next_return;
+		}
+		if (!is_pred(s)) {
+			return 0;
+		}
+
+		state.next_updated = true;
+		state.next_return = 0;
+		state.next_is_predictor = true;
+
+		if (key(matching) == key(s)) {
+			state.next_return = 2;
+			state.next_is_predictor = false;
+			remove_prediction(s);
+			return state.next_return;
+		}
+
+		if (nt(s)) {
+			process_matching(s, matching);
+			return states_[s].next_return;
+		}
+		else {
+			state.next_is_predictor = false;
+			remove_prediction(s);
+			return 0;
+		}
+	}
+
+	void CompactPredictor::update_predictors(handle_t s)
+	{
+		if (!is_pred(s) || !states_[s].next_updated) {
+			return;
+		}
+
+		states_[s].next_updated = false;
+
+		for (handle_t p : states_[s].predictors) {
+			update_predictors(p);
+		}
+
+		for (handle_t p : states_[s].next_new_predictor) {
+			become_predictor_down_left(p);
+		}
+
+		predictor_state_t& state = states_[s];
+		set_pred(s, state.next_is_predictor);
+		if (state.next_is_predictor) {
+			state.predictors = state.next_new_predictor;
+			state.predictors.insert(state.next_stay_predictor.begin(), state.next_stay_predictor.end());
+		}
+		else {
+			state.predictors.clear();
+			if (owner(s) != NIL) {
+				remove_prediction(s);
+			}
+		}
+
+		state.next_stay_predictor.clear();
+		state.next_new_predictor.clear();
+	}
+
+	void CompactPredictor::find_potential_predictors(handle_t occurrence, handle_t matching)
+	{
+		// the last symbol of a rule will disappear anyway
+		const handle_t o = owner(occurrence);
+		if (occurrence == matching || is_guard(next(occurrence)) || o == NIL) {
+			return;
+		}
+
+		become_predictor_down_right(first(o));
+		for (handle_t user : rules_[o].users) {
+			become_predictor_up(user, occurrence);
+		}
+	}
+
+	void CompactPredictor::find_new_predictors(handle_t s)
+	{
+		const handle_t* head = occurrence_heads_.find(key(s));
+		for (handle_t p = head ? *head : NIL; p != NIL; p = occurrences_[p].next) {
+			find_potential_predictors(p, s);
+		}
+	}
+
+	void CompactPredictor::drop_predictors(handle_t s)
+	{
+		if (!is_pred(s)) {
+			return;
+		}
+
+		set_pred(s, false);
+		const handle_t o = owner(s);
+		if (o != NIL) {
+			if (!nt(s)) {
+				remove_prediction(s);
+			}
+			for (handle_t user : rules_[o].users) {
+				states_[user].predictors.erase(s);
+			}
+		}
+
+		if (!nt(s)) {
+			states_[s].predictors.clear();
+			return;
+		}
+
+		handle_set_t children = std::move(states_[s].predictors);
+		const handle_set_t& users = rules_[rule(s)].users;
+		for (handle_t child : children) {
+			bool held = std::any_of(users.begin(), users.end(), [this, s, child](handle_t user) {
+				return user != s && states_[user].predictors.contains(child);
+			});
+			if (!held) {
+				drop_predictors(child);
+			}
+		}
+	}
+
+	// See Predictor::evict_oldest
+	void CompactPredictor::evict_oldest()
+	{
+		forget(first(axiom_));
+
+		while (!evicted_rules_.empty()) {
+			const handle_t r = evicted_rules_.back();
+			evicted_rules_.pop_back();
+
+			while (!is_guard(first(r))) {
+				forget(first(r));
+			}
+			free_rule(r);
+		}
+	}
+
+	void CompactPredictor::forget(handle_t s)
+	{
+		const handle_t r = nt(s) ? rule(s) : NIL;
+		drop_predictors(s);
+		free_symbol(release(s));
+
+		if (r != NIL && rules_[r].users.empty()) {
+			evicted_rules_.push_back(r);
+		}
+	}
+
+	bool CompactPredictor::checkLimits()
+	{
+		return trim(limit_);
+	}
+
+	bool CompactPredictor::trim(size_t limit)
+	{
+		if (auto sz = size(); sz < limit) {
+			return true;
+		}
+
+		++version_;
+		if (policy_ == limit_policy_t::EVICT) {
+			while (size() >= limit && rules_[axiom_].length != 0) {
+				evict_oldest();
+			}
+			return true;
+		}
+
+		predictions_.clear();
+		index_.clear();
+		occurrence_heads_.clear();
+		print_rules_.clear();
+		print_idx_ = version_ = 0ULL;
+
+		init();
+
+		return false;
+	}
+
+	void CompactPredictor::setLimits(size_t limit)
+	{
+		limit_ = limit;
+		index_.reserve(std::min(limit, INDEX_PRESIZE_LIMIT));
+	}
+
+	void CompactPredictor::setLimitPolicy(limit_policy_t policy) noexcept
+	{
+		policy_ = policy;
+	}
+
+	void CompactPredictor::save(utils::SnapshotWriter& writer) const
+	{
+		std::vector<snapshot::symbol_t> symbols(links_.size());
+		std::vector<snapshot::rule_t> rules(rules_.size());
+		std::vector<snapshot::predictor_t> predictors;
+		std::vector<uint32_t> digrams;
+
+		for (handle_t s = 1; s < links_.size(); ++s) {
+			const link_t& link = links_[s];
+			symbols[s] = snapshot::symbol_t{ link.sym, link.next, link.prev, link.owner, link.flags };
+			for (handle_t child : states_[s].predictors) {
+				predictors.push_back({ s, child });
+			}
+		}
+
+		for (handle_t r = 1; r < rules_.size(); ++r) {
+			if (rules_[r].alive) {
+				rules[r] = snapshot::rule_t{ rules_[r].guard, rules_[r].length };
+			}
+		}
+
+		index_.for_each([&digrams](handle_t s) {
+			digrams.push_back(s);
+		});
+
+		const std::vector<uint32_t> predictions(predictions_.begin(), predictions_.end());
+		snapshot::write(writer, snapshot::grammar_t{ axiom_, root_, symbols, rules, free_symbols_, free_rules_, predictors, predictions, digrams });
+	}
+
+	void CompactPredictor::load(utils::SnapshotReader& reader)
+	{
+		const snapshot::grammar_t g = snapshot::read(reader);
+		const size_t symbols = g.symbols.size();
+
+		links_.resize(symbols);
+		states_.assign(symbols, predictor_state_t{});
+		occurrences_.assign(symbols, occurrence_t{});
+		rules_.assign(g.rules.size(), rule_t{});
+		free_symbols_.assign(g.free_symbols.begin(), g.free_symbols.end());
+		free_rules_.assign(g.free_rules.begin(), g.free_rules.end());
+		axiom_ = g.axiom;
+		root_ = g.root;
+
+		links_[NIL] = link_t{};
+		for (handle_t s = 1; s < symbols; ++s) {
+			const snapshot::symbol_t& record = g.symbols[s];
+			links_[s] = link_t{ record.sym, record.next, record.prev, record.owner, record.flags };
+		}
+
+		predictions_.clear();
+		index_.clear();
+		occurrence_heads_.clear();
+		evicted_rules_.clear();
+		symbols_count_ = 0;
+
+		// users and occurrences are not saved, the rules give them back
+		rules_[axiom_].users.insert(root_);
+		for (handle_t r = 1; r < g.rules.size(); ++r) {
+			if (g.rules[r].guard == NIL) {
+				continue;
+			}
+
+			rule_t& rule_data = rules_[r];
+			rule_data.guard = g.rules[r].guard;
+			rule_data.length = g.rules[r].length;
+			rule_data.alive = true;
+			symbols_count_ += rule_data.length;
+		}
+
+		for (handle_t r = 1; r < g.rules.size(); ++r) {
+			if (!rules_[r].alive) {
+				continue;
+			}
+
+			for (handle_t s = first(r); s != rules_[r].guard; s = next(s)) {
+				if (nt(s)) {
+					rules_[rule(s)].users.insert(s);
+				}
+				link_occurrence(s);
+			}
+		}
+
+		for (const snapshot::predictor_t& p : g.predictors) {
+			states_[p.holder].predictors.insert(p.child);
+		}
+		for (handle_t s : g.predictions) {
+			add_prediction(s);
+		}
+
+		index_.reserve(std::max<size_t>(g.digrams.size(), std::min(limit_, INDEX_PRESIZE_LIMIT)));
+		for (handle_t s : g.digrams) {
+			index_.assign(key(s), key(next(s)), s);
+		}
+
+		++version_;
+	}
+
+	bool CompactPredictor::insert(uint64_t x)
+	{
+		bool is_limits = checkLimits();
+		++version_;
+		append(x, true);
+		return is_limits;
+	}
+
+	bool CompactPredictor::insert_batch(std::span<const uint64_t> xs, bool predict_last_only)
+	{
+		bool is_limits = true;
+		if (predict_last_only) {
+			clear_predictors(root_);
+			predictions_.clear();
+		}
+
+		size_t headroom = 0;
+		for (size_t i = 0; i < xs.size(); ++i) {
+			if (headroom == 0) {
+				is_limits &= checkLimits();
+				// over a limit that could not be met the check is repeated on every symbol
+				headroom = size() < limit_ ? limit_ - size() : 1;
+			}
+			--headroom;
+
+			const bool last = i + 1 == xs.size();
+			if (predict_last_only && last) {
+				predictions_.clear(); // nothing predicted inside the batch is valid
+			}
+			append(xs[i], !predict_last_only || last);
+		}
+
+		++version_;
+		return is_limits;
+	}
+
+	void CompactPredictor::clear_predictors(handle_t s)
+	{
+		if (!is_pred(s)) {
+			return;
+		}
+
+		set_pred(s, false);
+		for (handle_t child : states_[s].predictors) {
+			clear_predictors(child);
+		}
+		states_[s].predictors.clear();
+	}
+
+	void CompactPredictor::append(uint64_t x, bool predict)
+	{
+		const handle_t s = allocate_symbol(x, axiom_);
+		insert_after(last(axiom_), s);
+
+		if (!predict) {
+			check(prev(last(axiom_)));
+			return;
+		}
+
+		compute_next_predictors(root_, s);
+		update_predictors(root_);
+		check(prev(last(axiom_)));
+
+		if (!is_pred(root_)) {
+			find_new_predictors(last(axiom_));
+			compute_next_predictors(root_, s);
+			update_predictors(root_);
+		}
+	}
+
+	std::list<uint64_t> CompactPredictor::predict_next() const
+	{
+		std::list<uint64_t> result;
+		for (handle_t s : predictions_) {
+			if (!nt(s)) {
+				result.push_back(links_[s].sym);
+			}
+		}
+		return result;
+	}
+
+	CompactPredictor::iterator_range CompactPredictor::predict_range() const
+	{
+		return iterator_range{ prediction_iterator{ this, predictions_.begin() }, prediction_iterator{ this, predictions_.end() } };
+	}
+
+	size_t CompactPredictor::size() const
+	{
+		// same as the sum of length(), where an empty axiom counts as one
+		return symbols_count_ + (rules_[axiom_].length == 0 ? 1 : 0);
+	}
+
+	grammar_stats_t CompactPredictor::stats() const
+	{
+		return grammar_stats_t{ symbols_count_, rules_.size() - 1 - free_rules_.size(), index_.size(), predictions_.size() };
+	}
+
+	memory_usage_t CompactPredictor::memory_usage() const
+	{
+		memory_usage_t result;
+		result.symbols = links_.capacity() * sizeof(link_t);
+		result.rules = rules_.capacity() * sizeof(rule_t);
+		result.digram_index = index_.bytes();
+		result.occurrences = occurrences_.capacity() * sizeof(occurrence_t) + occurrence_heads_.bytes();
+		result.predictions = predictions_.heap_bytes();
+		result.other = (free_symbols_.capacity() + free_rules_.capacity() + print_rules_.capacity() + evicted_rules_.capacity()) * sizeof(handle_t);
+
+		// the states are the cold part of the symbols, they are counted with their sets
+		result.predictor_sets = states_.capacity() * sizeof(predictor_state_t);
+		for (const predictor_state_t& state : states_) {
+			result.predictor_sets += state.predictors.heap_bytes() + state.next_new_predictor.heap_bytes() + state.next_stay_predictor.heap_bytes();
+		}
+		for (const rule_t& rule : rules_) {
+			result.users_sets += rule.users.heap_bytes();
+		}
+
+		return result;
+	}
+
+	size_t CompactPredictor::footprint() const noexcept
+	{
+		const size_t symbols = links_.size() - free_symbols_.size();
+		const size_t rules = rules_.size() - free_rules_.size();
+		return symbols * (sizeof(link_t) + sizeof(predictor_state_t) + sizeof(occurrence_t)) + rules * sizeof(rule_t)
+			+ index_.live_bytes() + occurrence_heads_.live_bytes() + predictions_.size() * sizeof(handle_t);
+	}
+
+	std::list<CompactPredictor::iterator> CompactPredictor::predict_all() const
+	{
+		std::list<CompactPredictor::iterator> result;
+		for_each_cursor([this, &result](const cursor& c) {
+			result.push_back(CompactPredictor::iterator(this, c));
+		});
+
+		return result;
+	}
+
+	void CompactPredictor::print_rule(std::ostream& stream, handle_t r)
+	{
+		for (handle_t s = first(r); !is_guard(s); s = next(s)) {
+			if (nt(s)) {
+				uint64_t i{};
+				rule_t& sr = rules_[rule(s)];
+
+				if (print_rules_[sr.idx] == rule(s)) {
+					i = sr.idx;
+				}
+				else {
+					i = print_idx_;
+					sr.idx = static_cast<handle_t>(print_idx_);
+					print_rules_[print_idx_++] = rule(s);
+				}
+				stream << "[" << i << "] ";
+			}
+			else {
+				stream << links_[s].sym << ' ';
+			}
+		}
+	}
+
+	std::ostream& operator<<(std::ostream& stream, CompactPredictor& pred)
+	{
+		const size_t num_rules = std::count_if(pred.rules_.begin(), pred.rules_.end(), [](const auto& r) { return r.alive; });
+		pred.print_rules_.assign(2 * num_rules, CompactPredictor::NIL);
+		pred.print_rules_[0] = pred.axiom_;
+		pred.print_idx_ = 1;
+
+		for (uint64_t i = 0; i < pred.print_idx_; i++) {
+			stream << "[" << i << "] -> ";
+			pred.print_rule(stream, pred.print_rules_[i]);
+			if (i != pred.print_idx_ - 1) {
+				stream << std::endl;
+			}
+		}
+
+		pred.print_rules_.clear();
+		return stream;
+	}
+
+	CompactPredictor::iterator::iterator(const CompactPredictor* p, handle_t start)
+		: parent(p)
+		, version(p->version_)
+	{
+		if (start != NIL) {
+			stack.push(start);
+			for (handle_t s = start; p->nt(s); s = p->first(p->rule(s))) {
+				stack.push(p->first(p->rule(s)));
+			}
+		}
+	}
+
+	CompactPredictor::iterator::iterator(const CompactPredictor* p, std::stack<handle_t>& s, handle_t start)
+		: iterator(p, start)
+	{
+		while (!s.empty()) {
+			stack.push(s.top());
+			s.pop();
+		}
+	}
+
+	CompactPredictor::iterator::iterator(const CompactPredictor* p, const cursor& c)
+		: iterator(p)
+	{
+		for (uint32_t i = 0; i < c.depth_; ++i) {
+			stack.push(c.path_[i]);
+		}
+	}
+
+	CompactPredictor::iterator& CompactPredictor::iterator::operator++()
+	{
+		if (version != parent->version_) {
+			throw invalid_iterator();
+		}
+		if (stack.empty()) {
+			return *this;
+		}
+
+		handle_t current = stack.top();
+		stack.pop();
+
+		if (!parent->is_guard(parent->next(current))) {
+			handle_t s = parent->next(current);
+			stack.push(s);
+			while (parent->nt(s)) {
+				s = parent->first(parent->rule(s));
+				stack.push(s);
+			}
+		}
+		else {
+			++(*this);
+		}
+
+		return *this;
+	}
+
+	CompactPredictor::iterator CompactPredictor::iterator::operator++(int)
+	{
+		if (version != parent->version_) {
+			throw invalid_iterator();
+		}
+		iterator it(*this);
+		++(*this);
+		return it;
+	}
+
+	uint64_t CompactPredictor::iterator::operator*() const
+	{
+		if (version != parent->version_) {
+			throw invalid_iterator();
+		}
+
+		if (stack.empty()) {
+			return 0;
+		}
+
+		return parent->links_[stack.top()].sym;
+	}
+
+	bool CompactPredictor::iterator::operator==(const CompactPredictor::iterator& it)
+	{
+		return (parent == it.parent) && (version == it.version) && (stack == it.stack);
+	}
+
+	bool CompactPredictor::iterator::operator!=(const CompactPredictor::iterator& it)
+	{
+		return !(stack == it.stack);
+	}
+
+	uint64_t CompactPredictor::cursor::operator*() const
+	{
+		check();
+		return done() ? 0 : parent_->links_[path_[depth_ - 1]].sym;
+	}
+
+	CompactPredictor::cursor& CompactPredictor::cursor::operator++()
+	{
+		check();
+		while (depth_ != 0) {
+			handle_t s = parent_->next(path_[depth_ - 1]);
+			if (parent_->is_guard(s)) {
+				--depth_;
+				continue;
+			}
+
+			path_[depth_ - 1] = s;
+			while (parent_->nt(s)) {
+				s = parent_->first(parent_->rule(s));
+				push(s);
+			}
+			break;
+		}
+
+		return *this;
+	}
+
+	size_t CompactPredictor::cursor::advance(size_t steps)
+	{
+		size_t made = 0;
+		for (; made < steps && !done(); ++made) {
+			++(*this);
+		}
+
+		return made;
+	}
+
+	size_t CompactPredictor::cursor::read(std::span<uint64_t> out)
+	{
+		size_t count = 0;
+		for (; count < out.size() && !done(); ++count) {
+			out[count] = **this;
+			++(*this);
+		}
+
+		return count;
+	}
+
+	void CompactPredictor::cursor::push(handle_t s) noexcept
+	{
+		if (depth_ == MAX_DEPTH) {
+			std::move(path_.begin() + 1, path_.end(), path_.begin());
+			--depth_;
+			truncated_ = true;
+		}
+		path_[depth_++] = s;
+	}
+
+	void CompactPredictor::cursor::check() const
+	{
+		if (parent_ == nullptr || version_ != parent_->version_) {
+			throw invalid_cursor();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,326 @@
+#include "engines/context_predictor.hpp"
+#include "utils/hashing.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+
+namespace pIOn::engines
+{
+	ContextPredictor::ContextPredictor(size_t order, context_mode_t mode)
+		: order_(order)
+		, mode_(mode)
+	{
+		if (order_ == 0 || order_ > MAX_ORDER) {
+			throw std::runtime_error{ "Order of a context predictor must be from 1 to " + std::to_string(MAX_ORDER) };
+		}
+	}
+
+	bool ContextPredictor::insert(uint64_t x)
+	{
+		const bool within_limits = trim(limit_);
+		++version_;
+		append(x);
+		predict();
+		return within_limits;
+	}
+
+	bool ContextPredictor::insert_batch(std::span<const uint64_t> xs, bool)
+	{
+		// only the last predictions are seen, so they are made once either way
+		bool within_limits = true;
+		for (uint64_t x : xs) {
+			within_limits &= trim(limit_);
+			append(x);
+		}
+
+		++version_;
+		predict();
+		return within_limits;
+	}
+
+	ContextPredictor::iterator_range ContextPredictor::predict_range() const
+	{
+		return iterator_range{ predictions_.cbegin(), predictions_.cend() };
+	}
+
+	size_t ContextPredictor::size() const noexcept
+	{
+		return table_.size();
+	}
+
+	sequitur::grammar_stats_t ContextPredictor::stats() const noexcept
+	{
+		// a context is the index entry of the engine, there are no rules
+		return sequitur::grammar_stats_t{ successors_, 0, table_.size(), predictions_.size() };
+	}
+
+	sequitur::memory_usage_t ContextPredictor::memory_usage() const noexcept
+	{
+		sequitur::memory_usage_t result;
+		result.contexts = table_.bytes();
+		result.predictions = predictions_.capacity() * sizeof(prediction_t);
+		result.other = scratch_.capacity() * sizeof(uint64_t);
+		return result;
+	}
+
+	size_t ContextPredictor::footprint() const noexcept
+	{
+		return table_.live_bytes() + predictions_.size() * sizeof(prediction_t);
+	}
+
+	bool ContextPredictor::trim(size_t limit)
+	{
+		if (size() < limit) {
+			return true;
+		}
+
+		++version_;
+		if (policy_ == sequitur::limit_policy_t::EVICT) {
+			while (size() >= limit && size() != 0) {
+				age();
+			}
+			predict();
+			return true;
+		}
+
+		table_.clear();
+		predictions_.clear();
+		successors_ = 0;
+		return false;
+	}
+
+	void ContextPredictor::setLimits(size_t limit)
+	{
+		limit_ = limit;
+		table_.reserve(std::min(limit, PRESIZE_LIMIT));
+	}
+
+	void ContextPredictor::setLimitPolicy(sequitur::limit_policy_t policy) noexcept
+	{
+		policy_ = policy;
+	}
+
+	void ContextPredictor::save(utils::SnapshotWriter&) const
+	{
+		throw std::runtime_error{ "Snapshots of the context engines are not supported" };
+	}
+
+	void ContextPredictor::load(utils::SnapshotReader&)
+	{
+		throw std::runtime_error{ "Snapshots of the context engines are not supported" };
+	}
+
+	uint64_t ContextPredictor::contextOf(const std::array<uint64_t, MAX_ORDER>& history, size_t order) noexcept
+	{
+		// the order is mixed in, so the contexts of different orders do not collide
+		uint64_t result = order;
+		for (size_t i = 0; i < order; ++i) {
+			result = utils::mix128to64(result, history[i]);
+		}
+		return result;
+	}
+
+	void ContextPredictor::push(std::array<uint64_t, MAX_ORDER>& history, size_t& history_size, uint64_t x) noexcept
+	{
+		std::move_backward(history.begin(), history.end() - 1, history.end());
+		history[0] = x;
+		history_size = std::min(history_size + 1, MAX_ORDER);
+	}
+
+	void ContextPredictor::append(uint64_t x)
+	{
+		if (mode_ == context_mode_t::MARKOV) {
+			if (history_size_ >= order_) {
+				learn(contextOf(history_, order_), x);
+			}
+		}
+		else {
+			for (size_t order = 1; order <= std::min(order_, history_size_); ++order) {
+				learn(contextOf(history_, order), x);
+			}
+		}
+
+		push(history_, history_size_, x);
+	}
+
+	void ContextPredictor::learn(uint64_t context, uint64_t x)
+	{
+		context_t& c = table_[context];
+		++c.total;
+
+		size_t i = 0;
+		while (i < WAYS && c.ways[i].count != 0 && c.ways[i].sym != x) {
+			++i;
+		}
+		if (i == WAYS) {
+			// the least frequent successor gives its place to the new one
+			i = WAYS - 1;
+			c.total -= c.ways[i].count;
+			c.ways[i] = successor_t{ x, 0 };
+		}
+		else if (c.ways[i].count == 0) {
+			c.ways[i].sym = x;
+			++successors_;
+		}
+
+		++c.ways[i].count;
+		for (; i > 0 && c.ways[i - 1].count < c.ways[i].count; --i) {
+			std::swap(c.ways[i - 1], c.ways[i]);
+		}
+	}
+
+	void ContextPredictor::age()
+	{
+		scratch_.clear();
+		table_.for_each([this](const uint64_t& context, context_t& c) {
+			// halving keeps the ways sorted, the ones that reach zero are at the end
+			c.total = 0;
+			for (successor_t& way : c.ways) {
+				if (way.count == 0) {
+					continue;
+				}
+
+				way.count /= 2;
+				if (way.count == 0) {
+					way.sym = 0;
+					--successors_;
+				}
+				c.total += way.count;
+			}
+
+			if (c.total == 0) {
+				scratch_.push_back(context);
+			}
+		});
+
+		for (uint64_t context : scratch_) {
+			table_.erase(context);
+		}
+	}
+
+	void ContextPredictor::predict()
+	{
+		predictions_.clear();
+
+		if (mode_ == context_mode_t::MARKOV) {
+			const context_t* c = history_size_ >= order_ ? table_.find(contextOf(history_, order_)) : nullptr;
+			if (!c) {
+				return;
+			}
+
+			for (const successor_t& way : c->ways) {
+				if (way.count != 0) {
+					prediction_t& prediction = predictions_.emplace_back();
+					prediction.sym_ = way.sym;
+					prediction.freq_ = way.count;
+					prediction.probability_ = static_cast<double>(way.count) / static_cast<double>(c->total);
+				}
+			}
+			return;
+		}
+
+		// PPM, method C: a context gives count / (total + distinct) to its successors and escapes with
+		// the rest, the keys predicted by a longer context are excluded from the shorter ones
+		double escape = 1.0;
+		for (size_t order = std::min(order_, history_size_); order > 0; --order) {
+			const context_t* c = table_.find(contextOf(history_, order));
+			if (!c) {
+				continue;
+			}
+
+			const size_t excluded = predictions_.size();
+			auto is_excluded = [this, excluded](uint64_t sym) {
+				return std::any_of(predictions_.cbegin(), predictions_.cbegin() + excluded, [sym](const prediction_t& prediction) {
+					return prediction.sym_ == sym;
+				});
+			};
+
+			uint64_t total = 0, distinct = 0;
+			for (const successor_t& way : c->ways) {
+				if (way.count != 0 && !is_excluded(way.sym)) {
+					total += way.count;
+					++distinct;
+				}
+			}
+			if (distinct == 0) {
+				continue;
+			}
+
+			const double denominator = static_cast<double>(total + distinct);
+			for (const successor_t& way : c->ways) {
+				if (way.count != 0 && !is_excluded(way.sym)) {
+					prediction_t& prediction = predictions_.emplace_back();
+					prediction.sym_ = way.sym;
+					prediction.probability_ = escape * static_cast<double>(way.count) / denominator;
+				}
+			}
+			escape *= static_cast<double>(distinct) / denominator;
+		}
+
+		std::stable_sort(predictions_.begin(), predictions_.end(), [](const prediction_t& lhs, const prediction_t& rhs) {
+			return lhs.probability_ > rhs.probability_;
+		});
+		for (prediction_t& prediction : predictions_) {
+			prediction.freq_ = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(prediction.probability_ * PPM_SCALE)));
+		}
+	}
+
+	const ContextPredictor::successor_t* ContextPredictor::best(const std::array<uint64_t, MAX_ORDER>& history, size_t history_size) const noexcept
+	{
+		const size_t shortest = mode_ == context_mode_t::MARKOV ? order_ : 1;
+		for (size_t order = std::min(order_, history_size); order >= shortest && order > 0; --order) {
+			if (const context_t* c = table_.find(contextOf(history, order)); c && c->ways[0].count != 0) {
+				return &c->ways[0];
+			}
+		}
+
+		return nullptr;
+	}
+
+	uint64_t ContextPredictor::cursor::operator*() const
+	{
+		check();
+		return sym_;
+	}
+
+	ContextPredictor::cursor& ContextPredictor::cursor::operator++()
+	{
+		check();
+		if (!done()) {
+			push(history_, history_size_, sym_);
+			const successor_t* next = parent_->best(history_, history_size_);
+			sym_ = next ? next->sym : 0;
+		}
+
+		return *this;
+	}
+
+	size_t ContextPredictor::cursor::advance(size_t steps)
+	{
+		size_t made = 0;
+		for (; made < steps && !done(); ++made) {
+			++(*this);
+		}
+
+		return made;
+	}
+
+	size_t ContextPredictor::cursor::read(std::span<uint64_t> out)
+	{
+		size_t count = 0;
+		for (; count < out.size() && !done(); ++count) {
+			out[count] = **this;
+			++(*this);
+		}
+
+		return count;
+	}
+
+	void ContextPredictor::cursor::check() const
+	{
+		if (parent_ == nullptr || version_ != parent_->version_) {
+			throw invalid_cursor();
+		}
+	}
+}
\ No newline at end of file
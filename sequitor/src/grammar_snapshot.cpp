@@ -0,0 +1,101 @@
+#include <vector>
+#include <stdexcept>
+#include "grammar_snapshot.hpp"
+
+namespace pIOn::sequitur::snapshot
+{
+	void write(utils::SnapshotWriter& writer, const grammar_t& grammar)
+	{
+		writer.write(grammar.axiom);
+		writer.write(grammar.root);
+		writer.write_array(grammar.symbols.data(), grammar.symbols.size());
+		writer.write_array(grammar.rules.data(), grammar.rules.size());
+		writer.write_array(grammar.free_symbols.data(), grammar.free_symbols.size());
+		writer.write_array(grammar.free_rules.data(), grammar.free_rules.size());
+		writer.write_array(grammar.predictors.data(), grammar.predictors.size());
+		writer.write_array(grammar.predictions.data(), grammar.predictions.size());
+		writer.write_array(grammar.digrams.data(), grammar.digrams.size());
+	}
+
+	static void expect(bool condition, const char* what)
+	{
+		if (!condition) {
+			throw std::runtime_error{ std::string{ "Corrupted grammar snapshot: " } + what };
+		}
+	}
+
+	grammar_t read(utils::SnapshotReader& reader)
+	{
+		grammar_t g;
+		g.axiom = reader.read<uint32_t>();
+		g.root = reader.read<uint32_t>();
+		g.symbols = reader.read_array<symbol_t>();
+		g.rules = reader.read_array<rule_t>();
+		g.free_symbols = reader.read_array<uint32_t>();
+		g.free_rules = reader.read_array<uint32_t>();
+		g.predictors = reader.read_array<predictor_t>();
+		g.predictions = reader.read_array<uint32_t>();
+		g.digrams = reader.read_array<uint32_t>();
+
+		const size_t symbols = g.symbols.size();
+		const size_t rules = g.rules.size();
+		expect(symbols > 1 && symbols < ~uint32_t{} && rules > 1 && rules < ~uint32_t{}, "sizes");
+		expect(g.axiom != 0 && g.axiom < rules && g.rules[g.axiom].guard != 0, "axiom");
+		expect(g.root != 0 && g.root < symbols, "root");
+
+		auto is_nt = [&g](uint32_t s) { return !(g.symbols[s].flags & TERMINAL) && g.symbols[s].sym != 0; };
+		auto is_rule = [&g, rules](uint64_t r) { return r != 0 && r < rules && g.rules[r].guard != 0; };
+
+		const symbol_t& root = g.symbols[g.root];
+		expect(is_nt(g.root) && root.sym == g.axiom && root.owner == 0, "root");
+
+		// every symbol belongs to exactly one rule
+		std::vector<uint8_t> live(symbols, 0);
+		live[g.root] = 1;
+		for (uint32_t r = 1; r < rules; ++r) {
+			const uint32_t guard = g.rules[r].guard;
+			if (guard == 0) {
+				continue;
+			}
+
+			expect(guard < symbols && !live[guard] && is_nt(guard) && g.symbols[guard].sym == r, "guard");
+			live[guard] = 1;
+
+			uint32_t length = 0;
+			for (uint32_t s = guard;;) {
+				const symbol_t& sym = g.symbols[s];
+				expect(sym.next != 0 && sym.next < symbols && g.symbols[sym.next].prev == s, "links");
+				expect(sym.owner == r, "owner");
+				s = sym.next;
+				if (s == guard) {
+					break;
+				}
+
+				expect(!live[s] && (!is_nt(s) || is_rule(g.symbols[s].sym)), "symbol");
+				live[s] = 1;
+				++length;
+			}
+			expect(g.rules[r].length == length, "rule length");
+		}
+
+		auto is_live = [&live, symbols](uint32_t s) { return s != 0 && s < symbols && live[s]; };
+		auto is_guard = [&g, &is_nt](uint32_t s) { return is_nt(s) && g.rules[g.symbols[s].sym].guard == s; };
+		for (uint32_t s : g.free_symbols) {
+			expect(s != 0 && s < symbols && !live[s], "free symbols");
+		}
+		for (uint32_t r : g.free_rules) {
+			expect(r != 0 && r < rules && g.rules[r].guard == 0, "free rules");
+		}
+		for (const predictor_t& p : g.predictors) {
+			expect(is_live(p.holder) && is_live(p.child), "predictors");
+		}
+		for (uint32_t s : g.predictions) {
+			expect(is_live(s) && !is_nt(s), "predictions");
+		}
+		for (uint32_t s : g.digrams) {
+			expect(is_live(s) && s != g.root && !is_guard(s) && !is_guard(g.symbols[s].next), "digrams");
+		}
+
+		return g;
+	}
+}
\ No newline at end of file
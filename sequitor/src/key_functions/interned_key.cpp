@@ -0,0 +1,66 @@
+#include "key_functions/interned_key.hpp"
+#include <algorithm>
+
+namespace pIOn::keys
+{
+	InternedKey::InternedKey(size_t capacity) noexcept
+		: capacity_(std::clamp<size_t>(capacity, 1, MAX_IDS))
+	{}
+
+	uint64_t InternedKey::to_key(const blk_info_t& info, uint64_t)
+	{
+		const std::pair<uint64_t, uint64_t> request{ info.lba(), info.size() << 2 | (info.type() & 3) };
+		auto [id, is_new] = ids_.try_emplace(request);
+		if (is_new) {
+			if (room() == 0) {
+				clear();
+				id = ids_.try_emplace(request).first;
+			}
+			requests_.push_back({ info.lba(), info.size(), info.type() });
+			*id = static_cast<uint32_t>(requests_.size());
+		}
+
+		return *id;
+	}
+
+	void InternedKey::to_keys(std::span<const blk_info_t> infos, uint64_t* keys, uint64_t)
+	{
+		for (const blk_info_t& info : infos) {
+			*keys++ = InternedKey::to_key(info);
+		}
+	}
+
+	BlkInfoBuilder InternedKey::from_key(uint64_t sym, uint64_t) const noexcept
+	{
+		BlkInfoBuilder builder;
+		if (sym == 0 || sym > requests_.size()) {
+			return builder;
+		}
+
+		const request_t& request = requests_[sym - 1];
+		builder.setSector(request.lba).setSize(request.size).setOp(request.op);
+		return builder;
+	}
+
+	void InternedKey::clear() noexcept
+	{
+		// unlike FlatMap::clear, the memory is released, the table is forgotten to make room
+		ids_ = utils::FlatMap<std::pair<uint64_t, uint64_t>, uint32_t>{};
+		requests_ = std::vector<request_t>{};
+	}
+
+	size_t InternedKey::bytes() const noexcept
+	{
+		return ids_.bytes() + requests_.capacity() * sizeof(request_t);
+	}
+
+	size_t InternedKey::size() const noexcept
+	{
+		return requests_.size();
+	}
+
+	size_t InternedKey::room() const noexcept
+	{
+		return capacity_ - requests_.size();
+	}
+}
\ No newline at end of file
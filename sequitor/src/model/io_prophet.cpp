@@ -1,14 +1,148 @@
 #include "model/io_prophet.hpp"
-#include "key_functions/standart_key.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/snapshot.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string>
+#include <stdexcept>
 #include <cassert>
 
 namespace pIOn::model
 {
+	namespace
+	{
+		constexpr uint64_t SNAPSHOT_MAGIC = 0x50414E53'6E4F4970ULL; // "pIOnSNAP"
+		constexpr uint32_t SNAPSHOT_VERSION = 2;        // 2 - the sketches of the arrivals follow the times
+		constexpr uint32_t SNAPSHOT_VERSION_NO_SKETCHES = 1;
+		constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+		// Share of the memory limit the grammar is trimmed to, the rest is left for the next inserts
+		constexpr double TRIM_RATIO = 0.75;
+
+		constexpr uint64_t SECTOR_SIZE = 512;
+
+		// Contexts of the size model, there are few sizes and so few contexts of them
+		constexpr size_t SIZE_MODEL_LIMIT = 1024;
+
+		// Pairs of the default time table per symbol of the grammar limit, the pairs of the live symbols
+		// and a few of the evicted ones, whose times come back with them
+		constexpr size_t TIME_PAIRS_PER_SYMBOL = 2;
+
+		// Hit rates kept per symbol of the grammar limit. An evicting grammar never resets,
+		// so the rates of the symbols it has forgotten are dropped with the rest at that bound
+		constexpr size_t HIT_RATES_PER_SYMBOL = 2;
+
+		// A region level gives hints only if it has been right that often
+		constexpr double MIN_REGION_HIT_RATE = 0.5;
+
+		size_t timeTableLimit(const prophet_cfg_t& config) noexcept
+		{
+			if (config.time_table_limit_ != prophet_cfg_t::TIME_TABLE_DERIVED) {
+				return config.time_table_limit_;
+			}
+
+			// an unbounded grammar leaves the table unbounded too
+			const size_t symbols = std::max<size_t>(config.grammar_limits_, 1);
+			return symbols > std::numeric_limits<size_t>::max() / TIME_PAIRS_PER_SYMBOL ? 0 : symbols * TIME_PAIRS_PER_SYMBOL;
+		}
+
+		// The size of a request in bytes, never 0
+		uint64_t sizeKey(const blk_info_t& info) noexcept
+		{
+			return info.size() + 1;
+		}
+
+		// The region of a request with its op, never 0
+		uint64_t regionKey(const blk_info_t& info, uint64_t sectors) noexcept
+		{
+			return info.lba() / sectors << 2 | (info.type() == OPERATION::READ ? 1 : 2);
+		}
+
+		// One entry of time_table_
+		struct time_record_t
+		{
+			uint64_t from{};
+			uint64_t to{};
+			uint32_t n{};
+			uint32_t reserved{};
+			double mean{};
+			double var{};
+			double min{};
+			double max{};
+			double weighted{};
+		};
+		static_assert(sizeof(time_record_t) == 64, "time_record_t has to be padding-free!");
+	}
+
+	static_assert(engines::engine<sequitur::Predictor>);
+	static_assert(engines::engine<sequitur::CompactPredictor>);
+	static_assert(engines::engine<engines::ContextPredictor>);
+	static_assert(keys::key_holder<keys::StandartKey>);
+	static_assert(keys::key_holder<keys::DeltaKey>);
+	static_assert(keys::key_holder<keys::InternedKey>);
+	static_assert(keys::key_holder<keys::SectorKey>);
+	static_assert(keys::key_holder<keys::OffsetKey>);
+
 	IOProphet::IOProphet(const prophet_cfg_t& config)
-		: predictor_{ std::make_unique<pIOn::sequitur::Predictor>() }
+		: predictor_(makePredictor(config))
+		, streams_(config.stride_streams_)
+		, region_readahead_(config.region_readahead_)
+		, key_(makeKey(config.key_))
+	{
+		uint64_t finer = 0;
+		for (uint64_t bytes : config.region_levels_) {
+			if (bytes % SECTOR_SIZE != 0 || bytes <= finer) {
+				throw std::runtime_error{ "Region levels must be growing multiples of the sector = " + std::to_string(bytes) };
+			}
+
+			finer = bytes;
+			regions_.push_back({ bytes / SECTOR_SIZE, makePredictor(config) });
+		}
+		if (config.factorized_) {
+			size_model_ = std::make_unique<engines::ContextPredictor>(config.context_order_, engines::context_mode_t::PPM);
+		}
+
+		setGrammarSizeLimits(config.grammar_limits_);
+		setGrammarLimitPolicy(config.limit_policy_);
+		time_table_.setCapacity(timeTableLimit(config));
+		is_interning_ = config.key_ == key_function_t::INTERNED;
+		published_ = std::make_unique<published_t>();
+		is_publishing_ = config.publish_predictions_;
+		memory_limit_ = config.memory_limit_;
+	}
+
+	IOProphet::predictor_t IOProphet::makePredictor(const prophet_cfg_t& config)
 	{
-		predictor_->setLimits(config.grammar_limits_);
-		key_ = std::make_unique<keys::StandartKey>();
+		switch (config.engine_)
+		{
+		case engines::engine_t::MARKOV:
+			return std::make_unique<engines::ContextPredictor>(config.context_order_, engines::context_mode_t::MARKOV);
+		case engines::engine_t::PPM:
+			return std::make_unique<engines::ContextPredictor>(config.context_order_, engines::context_mode_t::PPM);
+		default:
+			if (config.storage_ == grammar_storage_t::COMPACT) {
+				return std::make_unique<pIOn::sequitur::CompactPredictor>();
+			}
+			return std::make_unique<pIOn::sequitur::Predictor>();
+		}
+	}
+
+	IOProphet::key_holder_t IOProphet::makeKey(key_function_t function)
+	{
+		switch (function)
+		{
+		case key_function_t::DELTA:
+			return keys::DeltaKey{};
+		case key_function_t::INTERNED:
+			return keys::InternedKey{};
+		case key_function_t::SECTOR:
+			return keys::SectorKey{};
+		case key_function_t::OFFSET:
+			return keys::OffsetKey{};
+		default:
+			return keys::StandartKey{};
+		}
 	}
 
 	IOProphet::IOProphet(IOProphet&& other) noexcept
@@ -21,15 +155,41 @@ namespace pIOn::model
 		if (this != std::addressof(other))
 		{
 			predictor_ = std::move(other.predictor_);
+			time_table_ = std::move(other.time_table_);
+			batch_keys_ = std::move(other.batch_keys_);
+			prev_sym_ = std::exchange(other.prev_sym_, 0);
+			prev_time_ = std::exchange(other.prev_time_, 0.0);
+			key_ = std::move(other.key_);
+			hit_rates_ = std::move(other.hit_rates_);
+			candidates_ = std::move(other.candidates_);
+			prediction_stats_ = std::exchange(other.prediction_stats_, {});
+			published_ = std::move(other.published_);
+			is_publishing_ = other.is_publishing_;
+			is_interning_ = other.is_interning_;
+			memory_limit_ = other.memory_limit_;
+			streams_ = std::move(other.streams_);
+			batch_infos_ = std::move(other.batch_infos_);
+			regions_ = std::move(other.regions_);
+			region_readahead_ = other.region_readahead_;
+			last_info_ = other.last_info_;
+			size_model_ = std::move(other.size_model_);
 		}
 
 		return *this;
 	}
 
 	double IOProphet::predictAverageTime() const
+	{
+		return std::visit([this](const auto& predictor) {
+			return predictAverageTime(*predictor);
+		}, predictor_);
+	}
+
+	template<typename PredictorT>
+	double IOProphet::predictAverageTime(const PredictorT& predictor) const
 	{
 		double predicted_time{ 0.0 };
-		auto iter_range = predictor_->predict_range();
+		auto iter_range = predictor.predict_range();
 
 		for (auto iter : iter_range)
 		{
@@ -48,46 +208,801 @@ namespace pIOn::model
 
 	[[nodiscard]] IOProphet::predict_pack_t IOProphet::predict() const
 	{
-		const double predicted_time = predictAverageTime();
-		auto iter_range = predictor_->predict_range();
 		predict_pack_t result;
+		std::visit([this, &result](const auto& predictor, const auto& key) {
+			predict(*predictor, key, result);
+		}, predictor_, key_);
+
+		return result;
+	}
+
+	template<typename PredictorT, keys::key_holder KeyT>
+	void IOProphet::predict(const PredictorT& predictor, const KeyT& key, predict_pack_t& result) const
+	{
+		const double predicted_time = predictAverageTime(predictor);
+		auto iter_range = predictor.predict_range();
+		result.clear();
 		result.reserve(iter_range.size());
 
+		std::array<size_prediction_t, MAX_SIZES> sizes{};
+		const size_t sizes_count = predictSizes(sizes);
 		for (auto iter : iter_range)
 		{
-			if (iter->term()) {
-				auto& builder = key_->from_key(iter->get_symbol());
-				builder.setTime(predicted_time);
-				result.push_back(std::make_pair(builder.build(), iter->freq()));
+			if (!iter->term()) {
+				continue;
+			}
+
+			BlkInfoBuilder builder = key.from_key(iter->get_symbol(), last_info_.lba());
+			builder.setTime(predicted_time);
+			const arrival_t arrival = predictArrival(prev_sym_, iter->get_symbol());
+			if (!size_model_) {
+				result.push_back({ builder.build(), iter->freq(), arrival });
+				continue;
+			}
+
+			// the request with every likely size, weighted by both models
+			for (size_t i = 0; i < sizes_count; ++i) {
+				builder.setSize(sizes[i].first);
+				const weight_t weight = iter->freq() * sizes[i].second / engines::ContextPredictor::PPM_SCALE;
+				result.push_back({ builder.build(), std::max<weight_t>(weight, 1), arrival });
 			}
 		}
 
-		return result;
+		predictStreams(result);
+		if (result.empty()) {
+			predictRegions(result);
+		}
+	}
+
+	void IOProphet::predictStreams(predict_pack_t& result) const
+	{
+		streams_.for_each_stream([this, &result](const StrideDetector::stream_t& stream) {
+			const blk_info_t info = streams_.predict(stream);
+			result.push_back({ info, stream.run, { info.time(), info.time(), info.time() } });
+		});
+	}
+
+	arrival_t IOProphet::predictArrival(uint64_t prev_sym, uint64_t sym) const
+	{
+		const SketchedStats<double>& stats = time_table_(prev_sym, sym);
+		const QuantileSketch& sketch = stats.getSketch();
+		if (sketch.empty()) {
+			return arrival_t{ stats.getStats(), stats.getStats(), stats.getStats() };
+		}
+
+		return arrival_t{ sketch.quantile(0.5), sketch.quantile(0.9), sketch.quantile(0.99) };
+	}
+
+	size_t IOProphet::fallbackLevel() const
+	{
+		for (size_t i = 0; i < regions_.size(); ++i) {
+			const bool is_predicting = std::visit([](const auto& predictor) {
+				return predictor->predict_range().size() != 0;
+			}, regions_[i].predictor);
+
+			const prediction_stats_t& stats = regions_[i].stats;
+			if (is_predicting && (stats.hits_ + 1.0) / (stats.requests_ + 2.0) >= MIN_REGION_HIT_RATE) {
+				return i;
+			}
+		}
+
+		return regions_.size();
+	}
+
+	void IOProphet::predictRegions(predict_pack_t& result) const
+	{
+		if (const size_t fallback = fallbackLevel(); fallback != regions_.size()) {
+			const region_level_t& level = regions_[fallback];
+			std::visit([this, &level, &result](const auto& predictor) {
+				for (auto iter : predictor->predict_range()) {
+					if (!iter->term()) {
+						continue;
+					}
+
+					// the rest of the region the last request is in, or the region from its start
+					const uint64_t key = iter->get_symbol();
+					const uint64_t start = (key >> 2) * level.sectors;
+					const uint64_t end = start + level.sectors;
+					uint64_t from = start;
+					if (last_info_.lba() >= start && last_info_.lba() < end) {
+						from = last_info_.lba() + last_info_.size() / SECTOR_SIZE;
+						from = from < end ? from : start;
+					}
+
+					const blk_info_t hint = BlkInfoBuilder{}
+						.setSector(from)
+						.setSize(std::min((end - from) * SECTOR_SIZE, region_readahead_))
+						.setOp((key & 3) == 1 ? 0 : 1)
+						.build();
+					result.push_back({ hint, iter->freq() });
+				}
+			}, level.predictor);
+		}
+	}
+
+	void IOProphet::predictAhead(size_t steps, predict_pack_t& result) const
+	{
+		std::visit([this, steps, &result](const auto& predictor, const auto& key) {
+			predictAhead(*predictor, key, steps, result);
+		}, predictor_, key_);
+	}
+
+	template<typename PredictorT, keys::key_holder KeyT>
+	void IOProphet::predictAhead(const PredictorT& predictor, const KeyT& key, size_t steps, predict_pack_t& result) const
+	{
+		std::array<size_prediction_t, MAX_SIZES> sizes{};
+		predictSizes(sizes);
+		predictor.for_each_cursor([this, &key, steps, size = sizes[0].first, &result](auto cursor) {
+			uint64_t prev_sym = prev_sym_;
+			uint64_t base = last_info_.lba(); // a relative key of a continuation follows the request predicted before it
+			double time = 0.0;                // since the last inserted request, as in predict()
+			arrival_t arrival{};
+
+			for (size_t i = 0; i < steps && !cursor.done(); ++i, ++cursor) {
+				const uint64_t sym = *cursor;
+				time += time_table_(prev_sym, sym).getStats();
+				const arrival_t step = predictArrival(prev_sym, sym);
+				arrival.p50_ += step.p50_;
+				arrival.p90_ += step.p90_;
+				arrival.p99_ += step.p99_;
+				prev_sym = sym;
+
+				BlkInfoBuilder builder = key.from_key(sym, base);
+				builder.setTime(time);
+				if (size_model_) {
+					builder.setSize(size);
+				}
+				const blk_info_t& info = result.emplace_back(builder.build(), cursor.freq(), arrival).info_;
+				base = info.lba();
+			}
+		});
+
+		streams_.for_each_stream([this, steps, &result](const StrideDetector::stream_t& stream) {
+			for (size_t i = 1; i <= steps; ++i) {
+				const blk_info_t info = streams_.predict(stream, i);
+				result.push_back({ info, stream.run, { info.time(), info.time(), info.time() } });
+			}
+		});
+	}
+
+	size_t IOProphet::predict_top(std::span<scored_prediction_t> out) const
+	{
+		if (out.empty()) {
+			return 0;
+		}
+
+		return std::visit([this, out](const auto& predictor, const auto& key) {
+			return predict_top(*predictor, key, out);
+		}, predictor_, key_);
+	}
+
+	template<typename PredictorT, keys::key_holder KeyT>
+	size_t IOProphet::predict_top(const PredictorT& predictor, const KeyT& key, std::span<scored_prediction_t> out) const
+	{
+		// the scratch of a thread, so that the calls from several threads do not share it
+		thread_local utils::FlatMap<uint64_t, double> candidates;
+		thread_local std::vector<std::pair<blk_info_t, uint32_t>> stream_infos;
+
+		// the same symbol may start several continuations, their support is summed up
+		candidates.clear();
+		double total = 0.0;
+		predictor.for_each_cursor([&total](const auto& cursor) {
+			const double support = 1.0 + static_cast<double>(cursor.support());
+			candidates[*cursor] += support;
+			total += support;
+		});
+
+		stream_infos.clear();
+		streams_.for_each_stream([this, &total](const StrideDetector::stream_t& stream) {
+			stream_infos.emplace_back(streams_.predict(stream), stream.run);
+			total += 1.0 + static_cast<double>(stream.run);
+		});
+
+		size_t count = 0;
+		auto offer = [out, &count](const blk_info_t& info, double confidence) {
+			if (count == out.size() && confidence <= out.back().confidence_) {
+				return;
+			}
+
+			// insertion into the sorted bounded buffer
+			size_t pos = count < out.size() ? count++ : out.size() - 1;
+			for (; pos > 0 && out[pos - 1].confidence_ < confidence; --pos) {
+				out[pos] = out[pos - 1];
+			}
+			out[pos] = scored_prediction_t{ info, confidence };
+		};
+
+		// the streams are not keyed, a request of a stream supports the candidate that decodes to it
+		auto is_same = [](const blk_info_t& lhs, const blk_info_t& rhs) {
+			return lhs.lba() == rhs.lba() && lhs.size() == rhs.size() && lhs.type() == rhs.type();
+		};
+
+		std::array<size_prediction_t, MAX_SIZES> sizes{};
+		predictSizes(sizes);
+		candidates.for_each([this, &key, &offer, &is_same, total, size = sizes[0].first](uint64_t sym, double support) {
+			BlkInfoBuilder builder = key.from_key(sym, last_info_.lba());
+			builder.setTime(time_table_(prev_sym_, sym).getStats());
+			if (size_model_) {
+				builder.setSize(size);
+			}
+			const blk_info_t info = builder.build();
+
+			const hit_rate_t* rate = hit_rates_.find(sym);
+			double hit_rate = rate ? (rate->hits + 1.0) / (rate->predicted + 2.0) : 0.5;
+			for (auto& [stream_info, run] : stream_infos) {
+				if (run != 0 && is_same(stream_info, info)) {
+					support += 1.0 + run;
+					hit_rate = (run + 1.0) / (run + 2.0);
+					run = 0;
+				}
+			}
+			offer(info, support / total * hit_rate);
+		});
+
+		// a stream that has kept its stride run times is as likely to keep it once more
+		for (const auto& [info, run] : stream_infos) {
+			if (run != 0) {
+				offer(info, (1.0 + run) / total * ((run + 1.0) / (run + 2.0)));
+			}
+		}
+
+		return count;
+	}
+
+	void IOProphet::countHits(uint64_t sym, bool is_size_hit)
+	{
+		candidates_.clear();
+		std::visit([this, sym](const auto& predictor) {
+			for (auto iter : predictor->predict_range()) {
+				if (!iter->term() || !candidates_.try_emplace(iter->get_symbol()).second) {
+					continue;
+				}
+
+				hit_rate_t& rate = hit_rates_[iter->get_symbol()];
+				++rate.predicted;
+				rate.hits += iter->get_symbol() == sym;
+			}
+		}, predictor_);
+		if (hit_rates_limit_ != 0 && hit_rates_.size() > hit_rates_limit_) {
+			hit_rates_ = utils::FlatMap<uint64_t, hit_rate_t>{};
+		}
+
+		++prediction_stats_.requests_;
+		prediction_stats_.hits_ += is_size_hit && candidates_.contains(sym);
+	}
+
+	blk_info_t IOProphet::withoutSize(const blk_info_t& info) const noexcept
+	{
+		if (!size_model_) {
+			return info;
+		}
+
+		return BlkInfoBuilder{}
+			.setSector(info.lba())
+			.setTime(info.time())
+			.setOp(info.type())
+			.setPid(info.pid())
+			.setCpu(info.cpu())
+			.build();
+	}
+
+	size_t IOProphet::predictSizes(std::span<size_prediction_t> out) const
+	{
+		if (!size_model_ || out.empty()) {
+			return 0;
+		}
+
+		// the PPM predictions go from the most likely one, with nothing learned the size is kept
+		size_t count = 0;
+		for (auto iter : size_model_->predict_range()) {
+			if (count == out.size()) {
+				break;
+			}
+			out[count++] = { iter->get_symbol() - 1, iter->freq() };
+		}
+		if (count == 0) {
+			out[count++] = { last_info_.size(), engines::ContextPredictor::PPM_SCALE };
+		}
+
+		return count;
+	}
+
+	bool IOProphet::isSizePredicted(uint64_t size) const
+	{
+		if (!size_model_) {
+			return true;
+		}
+
+		std::array<size_prediction_t, MAX_SIZES> sizes{};
+		const size_t count = predictSizes(sizes);
+		return std::any_of(sizes.cbegin(), sizes.cbegin() + count, [size](const size_prediction_t& prediction) {
+			return prediction.first == size;
+		});
+	}
+
+	void IOProphet::learnRegions(const blk_info_t& info, bool is_predicted)
+	{
+		// the region hits are counted only where predict() falls back to a level
+		const size_t fallback = !is_predicted && streams_.size() == 0 ? fallbackLevel() : regions_.size();
+		for (size_t i = 0; i < regions_.size(); ++i) {
+			region_level_t& level = regions_[i];
+			const uint64_t key = regionKey(info, level.sectors);
+			std::visit([this, key, &level, is_fallback = i == fallback](auto& predictor) {
+				auto range = predictor->predict_range();
+				if (range.size() != 0) {
+					const bool is_hit = std::any_of(range.begin(), range.end(), [key](auto iter) {
+						return iter->term() && iter->get_symbol() == key;
+					});
+
+					++level.stats.requests_;
+					level.stats.hits_ += is_hit;
+					prediction_stats_.region_hits_ += is_hit && is_fallback;
+				}
+
+				predictor->insert(key);
+			}, level.predictor);
+		}
+
+		last_info_ = info;
+	}
+
+	void IOProphet::learnRegions(std::span<const blk_info_t> infos)
+	{
+		if (infos.empty()) {
+			return;
+		}
+
+		for (region_level_t& level : regions_) {
+			batch_keys_.resize(infos.size());
+			for (size_t i = 0; i < infos.size(); ++i) {
+				batch_keys_[i] = regionKey(infos[i], level.sectors);
+			}
+
+			std::visit([this](auto& predictor) {
+				predictor->insert_batch(batch_keys_, true);
+			}, level.predictor);
+		}
+
+		last_info_ = infos.back();
+	}
+
+	[[nodiscard]] IOProphet::published_t::reader_t IOProphet::getPublishedPredictions() const noexcept
+	{
+		return published_->read();
+	}
+
+	void IOProphet::setPublishPredictions(bool publish)
+	{
+		is_publishing_ = publish;
+		this->publish();
+	}
+
+	void IOProphet::publish()
+	{
+		if (!is_publishing_) {
+			return;
+		}
+
+		// the pack of an older publication is refilled, so its memory is reused
+		published_->publish([this](predict_pack_t& pack) {
+			std::visit([this, &pack](const auto& predictor, const auto& key) {
+				predict(*predictor, key, pack);
+			}, predictor_, key_);
+		});
 	}
 
 	[[nodiscard]] size_t IOProphet::getGrammarSize() const
 	{
-		return predictor_->size();
+		return std::visit([](const auto& predictor) {
+			return predictor->size();
+		}, predictor_);
+	}
+
+	[[nodiscard]] sequitur::grammar_stats_t IOProphet::getGrammarStats() const
+	{
+		return std::visit([](const auto& predictor) {
+			return predictor->stats();
+		}, predictor_);
+	}
+
+	[[nodiscard]] sequitur::memory_usage_t IOProphet::memory_usage() const
+	{
+		sequitur::memory_usage_t result = std::visit([](const auto& predictor) {
+			return predictor->memory_usage();
+		}, predictor_);
+
+		result.time_table = time_table_.bytes();
+		result.keys = keyBytes();
+		if (size_model_) {
+			result.contexts += size_model_->memory_usage().total();
+		}
+		for (const region_level_t& level : regions_) {
+			result.regions += std::visit([](const auto& predictor) {
+				return predictor->memory_usage().total();
+			}, level.predictor);
+		}
+		result.other += hit_rates_.bytes() + candidates_.bytes() + streams_.bytes()
+			+ batch_keys_.capacity() * sizeof(uint64_t) + batch_infos_.capacity() * sizeof(blk_info_t);
+		return result;
+	}
+
+	[[nodiscard]] size_t IOProphet::footprint() const noexcept
+	{
+		auto footprint = [](const auto& predictor) {
+			return predictor->footprint();
+		};
+
+		// the region levels and the size model
+		size_t models = size_model_ ? size_model_->footprint() : 0;
+		for (const region_level_t& level : regions_) {
+			models += std::visit(footprint, level.predictor);
+		}
+
+		return std::visit(footprint, predictor_) + models + time_table_.bytes() + hit_rates_.live_bytes() + streams_.bytes() + keyBytes();
+	}
+
+	[[nodiscard]] prediction_stats_t IOProphet::getPredictionStats() const noexcept
+	{
+		return prediction_stats_;
+	}
+
+	void IOProphet::setMemoryLimit(size_t bytes)
+	{
+		memory_limit_ = bytes;
+		checkMemoryLimit();
+	}
+
+	[[nodiscard]] size_t IOProphet::getMemoryLimit() const noexcept
+	{
+		return memory_limit_;
+	}
+
+	void IOProphet::checkMemoryLimit()
+	{
+		if (memory_limit_ == 0 || footprint() <= memory_limit_) {
+			return;
+		}
+
+		// the time table keeps every pair ever seen, so it may outgrow the grammar that made it
+		if (time_table_.bytes() + hit_rates_.live_bytes() > memory_limit_ / 2) {
+			clearTimes();
+		}
+
+		// the interned keys outlive the evicted symbols, so under any policy the table only shrinks with the whole grammar
+		if (keyBytes() > memory_limit_ / 4) {
+			clearTimes();
+			forgetKeys();
+		}
+
+		// the tables, streams and keys do not shrink with the grammars
+		size_t fixed = time_table_.bytes() + hit_rates_.live_bytes() + streams_.bytes() + keyBytes();
+		if (fixed >= memory_limit_ && is_interning_) {
+			clearTimes();
+			forgetKeys();
+			fixed = time_table_.bytes() + hit_rates_.live_bytes() + streams_.bytes() + keyBytes();
+		}
+
+		const size_t total = footprint();
+		if (total <= memory_limit_) {
+			return;
+		}
+
+		// bytes per symbol stay about the same, so every grammar shrinks in the same proportion
+		const double share = fixed < memory_limit_
+			? static_cast<double>(memory_limit_ - fixed) / static_cast<double>(total - fixed) * TRIM_RATIO
+			: 0.0;
+		auto trim = [share](auto& predictor) {
+			return predictor->trim(static_cast<size_t>(static_cast<double>(predictor->size()) * share));
+		};
+
+		for (region_level_t& level : regions_) {
+			std::visit(trim, level.predictor);
+		}
+		if (size_model_) {
+			trim(size_model_);
+		}
+
+		// the times and keys belong to the exact grammar only
+		if (!std::visit(trim, predictor_)) {
+			clearTimes();
+			forgetKeys();
+		}
+	}
+
+	uint64_t IOProphet::toKey(const blk_info_t& info)
+	{
+		reserveKeys(1);
+
+		// a relative key follows the last learned request
+		return std::visit([this, &info](auto& key) {
+			return key.to_key(info, last_info_.lba());
+		}, key_);
+	}
+
+	size_t IOProphet::keyBytes() const noexcept
+	{
+		return std::visit([](const auto& key) -> size_t {
+			if constexpr (requires { key.bytes(); }) {
+				return key.bytes();
+			}
+			else {
+				return 0;
+			}
+		}, key_);
+	}
+
+	void IOProphet::clearTimes()
+	{
+		time_table_.clear();
+		hit_rates_.clear();
+	}
+
+	void IOProphet::forgetKeys()
+	{
+		if (!is_interning_) {
+			return;
+		}
+
+		// the interned ids are given anew, so the grammar must not keep any of the old ones
+		std::visit([](auto& predictor) {
+			predictor->trim(0);
+		}, predictor_);
+		std::visit([](auto& key) {
+			if constexpr (requires { key.clear(); }) {
+				key.clear();
+			}
+		}, key_);
+		prev_sym_ = 0;
+	}
+
+	void IOProphet::reserveKeys(size_t count)
+	{
+		// the ids that would be given anew must not meet the old ones in the grammar
+		const bool is_full = std::visit([count](const auto& key) {
+			if constexpr (requires { key.room(); }) {
+				return key.room() < count;
+			}
+			else {
+				return false;
+			}
+		}, key_);
+
+		if (is_full) {
+			clearTimes();
+			forgetKeys();
+		}
 	}
 
 	void IOProphet::setGrammarSizeLimits(size_t limit)
 	{
-		predictor_->setLimits(limit);
+		std::visit([limit](auto& predictor) {
+			predictor->setLimits(limit);
+		}, predictor_);
+
+		// the levels share one limit, so the hierarchy costs no more than the exact grammar
+		for (region_level_t& level : regions_) {
+			std::visit([limit, this](auto& predictor) {
+				predictor->setLimits(std::max<size_t>(limit / regions_.size(), 1));
+			}, level.predictor);
+		}
+		if (size_model_) {
+			size_model_->setLimits(std::min(limit, SIZE_MODEL_LIMIT));
+		}
+		hit_rates_limit_ = limit > std::numeric_limits<size_t>::max() / HIT_RATES_PER_SYMBOL ? 0 : limit * HIT_RATES_PER_SYMBOL;
+	}
+
+	void IOProphet::insert_batch(std::span<const blk_info_t> infos, bool predict_last_only)
+	{
+		if (streams_.enabled()) {
+			batch_infos_.clear();
+			for (const blk_info_t& info : infos) {
+				if (streams_.observe(info)) {
+					++prediction_stats_.requests_;
+					++prediction_stats_.hits_;
+				}
+				else {
+					batch_infos_.push_back(info);
+				}
+			}
+
+			infos = batch_infos_;
+			if (infos.empty()) {
+				publish();
+				return;
+			}
+		}
+		const uint64_t base = last_info_.lba();
+		learnRegions(infos);
+
+		if (size_model_ && !infos.empty()) {
+			batch_keys_.resize(infos.size());
+			std::transform(infos.begin(), infos.end(), batch_keys_.begin(), sizeKey);
+			size_model_->insert_batch(batch_keys_, true);
+
+			// the engine learns the requests without their sizes
+			if (infos.data() != batch_infos_.data()) {
+				batch_infos_.assign(infos.begin(), infos.end());
+			}
+			for (blk_info_t& info : batch_infos_) {
+				info = withoutSize(info);
+			}
+			infos = batch_infos_;
+		}
+
+		batch_keys_.resize(infos.size());
+		reserveKeys(infos.size());
+		std::visit([this, infos, base](auto& key) {
+			key.to_keys(infos, batch_keys_.data(), base);
+		}, key_);
+		bool within_limits = std::visit([this, predict_last_only](auto& predictor) {
+			return predictor->insert_batch(batch_keys_, predict_last_only);
+		}, predictor_);
+
+		// unlike insert(), the times of a batch survive a reset in the middle of it
+		if (!within_limits) {
+			clearTimes();
+		}
+		// but its interned keys do not, the next request starts the grammar anew
+		if (!within_limits && is_interning_) {
+			forgetKeys();
+			checkMemoryLimit();
+			publish();
+			return;
+		}
+		for (size_t i = 0; i < infos.size(); ++i) {
+			const uint64_t sym = batch_keys_[i];
+			if (prev_sym_) {
+				time_table_(prev_sym_, sym).insert(infos[i].time());
+			}
+
+			prev_sym_ = sym;
+			prev_time_ += infos[i].time();
+		}
+
+		checkMemoryLimit();
+		publish();
+	}
+
+	void IOProphet::save(std::string_view path) const
+	{
+		if (is_interning_) {
+			throw std::runtime_error{ "Snapshots of the interned keys are not supported" };
+		}
+
+		std::ofstream file{ std::string{ path }, std::ios_base::binary | std::ios_base::trunc };
+		if (!file.is_open()) {
+			throw std::runtime_error{ "Cannot open the file = " + std::string{ path } };
+		}
+
+		std::vector<time_record_t> times;
+		std::vector<QuantileSketch> sketches; // of the times in the same order
+		time_table_.for_each([&times, &sketches](uint64_t from, uint64_t to, const SketchedStats<double>& stats) {
+			const auto state = stats.getState();
+			times.push_back({ from, to, state.n, 0, state.mean, state.var, state.min, state.max, stats.getStats() });
+			sketches.push_back(stats.getSketch());
+		});
+
+		utils::SnapshotWriter writer{ file };
+		writer.write(SNAPSHOT_MAGIC);
+		writer.write(SNAPSHOT_VERSION);
+		writer.write(SNAPSHOT_BYTE_ORDER);
+		writer.write(prev_sym_);
+		writer.write(prev_time_);
+		writer.write_array(times);
+		writer.write_array(sketches);
+
+		std::visit([&writer](const auto& predictor) {
+			predictor->save(writer);
+		}, predictor_);
+
+		if (!writer.good()) {
+			throw std::runtime_error{ "Cannot write the snapshot = " + std::string{ path } };
+		}
+	}
+
+	void IOProphet::load(std::string_view path)
+	{
+		if (is_interning_) {
+			throw std::runtime_error{ "Snapshots of the interned keys are not supported" };
+		}
+
+		const utils::MappedFile file{ path };
+		utils::SnapshotReader reader{ file.data(), file.size() };
+
+		if (reader.read<uint64_t>() != SNAPSHOT_MAGIC) {
+			throw std::runtime_error{ "Not a pIOn snapshot = " + std::string{ path } };
+		}
+		const uint32_t version = reader.read<uint32_t>();
+		if ((version != SNAPSHOT_VERSION && version != SNAPSHOT_VERSION_NO_SKETCHES) || reader.read<uint32_t>() != SNAPSHOT_BYTE_ORDER) {
+			throw std::runtime_error{ "Unsupported snapshot version or byte order = " + std::string{ path } };
+		}
+
+		const uint64_t prev_sym = reader.read<uint64_t>();
+		const double prev_time = reader.read<double>();
+		const auto times = reader.read_array<time_record_t>();
+		const auto sketches = version == SNAPSHOT_VERSION ? reader.read_array<QuantileSketch>() : std::span<const QuantileSketch>{};
+		if (!sketches.empty() && sketches.size() != times.size()) {
+			throw std::runtime_error{ "Sketches do not match the times of the snapshot = " + std::string{ path } };
+		}
+
+		// the grammar is checked before it replaces the current one
+		std::visit([&reader](auto& predictor) {
+			predictor->load(reader);
+		}, predictor_);
+
+		prev_sym_ = prev_sym;
+		prev_time_ = prev_time;
+		clearTimes();
+		for (size_t i = 0; i < times.size(); ++i) {
+			const time_record_t& record = times[i];
+			SketchedStats<double>& stats = time_table_(record.from, record.to);
+			stats.setState({ record.n, record.mean, record.var, record.min, record.max });
+			stats.setStats(record.weighted);
+			if (!sketches.empty()) {
+				stats.setSketch(sketches[i]);
+			}
+		}
+
+		publish();
+	}
+
+	void IOProphet::setGrammarLimitPolicy(sequitur::limit_policy_t policy)
+	{
+		auto set = [policy](auto& predictor) {
+			predictor->setLimitPolicy(policy);
+		};
+
+		std::visit(set, predictor_);
+		for (region_level_t& level : regions_) {
+			std::visit(set, level.predictor);
+		}
+		if (size_model_) {
+			size_model_->setLimitPolicy(policy);
+		}
 	}
 
 	void IOProphet::insert(const blk_info_t& info)
 	{
-		auto sym = key_->to_key(info);
-		bool is_limits = predictor_->insert(sym);
+		// the next request of an established stream is known, the grammar would only learn a new symbol from it
+		if (streams_.observe(info)) {
+			++prediction_stats_.requests_;
+			++prediction_stats_.hits_;
+			publish();
+			return;
+		}
 
-		if (prev_sym_) {
-			time_table_(prev_sym_, sym).insert(static_cast<double>(info.time() - prev_time_));
+		const blk_info_t learned = withoutSize(info);
+		auto sym = toKey(learned);
+		countHits(sym, isSizePredicted(info.size()));
+		learnRegions(info, !candidates_.empty());
+		if (size_model_) {
+			size_model_->insert(sizeKey(info));
 		}
-		if (is_limits) {
-			time_table_.clear();
+
+		// false only if the grammar has been thrown away, the eviction keeps it
+		bool within_limits = std::visit([sym](auto& predictor) {
+			return predictor->insert(sym);
+		}, predictor_);
+
+		if (!within_limits) {
+			clearTimes();
+		}
+		// the grammar has been reset with the key just interned, it is learned again with a new id
+		if (!within_limits && is_interning_) {
+			forgetKeys();
+			sym = toKey(learned);
+			std::visit([sym](auto& predictor) {
+				predictor->insert(sym);
+			}, predictor_);
+		}
+		if (prev_sym_) {
+			time_table_(prev_sym_, sym).insert(info.time());
 		}
 
 		prev_sym_ = sym;
-		prev_time_ = info.time();
+		prev_time_ += info.time();
+
+		checkMemoryLimit();
+		publish();
 	}
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "model/memory_budget.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace pIOn::model
+{
+	MemoryBudget::MemoryBudget(const budget_cfg_t& config)
+		: config_(config)
+	{
+		if (config_.total_bytes_ == 0) {
+			throw std::runtime_error{ "Memory budget must be positive!" };
+		}
+		config_.smoothing_ = std::clamp(config_.smoothing_, 0.0, 1.0);
+	}
+
+	void MemoryBudget::attach(IOProphet& prophet)
+	{
+		models_.push_back({ &prophet, prophet.getPredictionStats() });
+		prophet.setMemoryLimit(floor());
+	}
+
+	void MemoryBudget::detach(const IOProphet& prophet)
+	{
+		std::erase_if(models_, [&prophet](const model_t& model) {
+			return model.prophet == &prophet;
+		});
+	}
+
+	void MemoryBudget::rebalance()
+	{
+		if (models_.empty()) {
+			return;
+		}
+
+		double total_value = 0.0;
+		for (model_t& model : models_) {
+			const prediction_stats_t stats = model.prophet->getPredictionStats();
+			const double requests = static_cast<double>(stats.requests_ - model.seen.requests_);
+			const double hits = static_cast<double>(stats.hits_ - model.seen.hits_);
+			model.seen = stats;
+
+			// the expected hits of the period, a busy prophet that has not learned yet still gets a little
+			const double value = requests * (hits + 1.0) / (requests + 2.0);
+			model.value = model.is_new ? value : config_.smoothing_ * value + (1.0 - config_.smoothing_) * model.value;
+			model.is_new = false;
+			total_value += model.value;
+		}
+
+		const size_t floor = this->floor();
+		const size_t spare = config_.total_bytes_ - floor * models_.size();
+
+		// a prophet that got less than its footprint trims its grammar right here
+		for (const model_t& model : models_) {
+			const double share = total_value > 0.0 ? model.value / total_value : 1.0 / static_cast<double>(models_.size());
+			model.prophet->setMemoryLimit(floor + static_cast<size_t>(static_cast<double>(spare) * share));
+		}
+	}
+
+	[[nodiscard]] size_t MemoryBudget::footprint() const noexcept
+	{
+		size_t result = 0;
+		for (const model_t& model : models_) {
+			result += model.prophet->footprint();
+		}
+		return result;
+	}
+
+	[[nodiscard]] size_t MemoryBudget::size() const noexcept
+	{
+		return models_.size();
+	}
+
+	[[nodiscard]] const budget_cfg_t& MemoryBudget::getConfig() const noexcept
+	{
+		return config_;
+	}
+
+	size_t MemoryBudget::floor() const noexcept
+	{
+		const size_t count = std::max<size_t>(models_.size(), 1);
+		return std::min(config_.min_bytes_, config_.total_bytes_ / count);
+	}
+}
\ No newline at end of file
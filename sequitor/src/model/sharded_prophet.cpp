@@ -0,0 +1,219 @@
+#include "model/sharded_prophet.hpp"
+#include "utils/hashing.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace pIOn::model
+{
+	ShardedProphet::ShardedProphet(const sharded_cfg_t& config)
+		: config_(config)
+	{
+		if (config_.workers_ == 0) {
+			config_.workers_ = std::max(1U, std::thread::hardware_concurrency());
+		}
+		config_.batch_size_ = std::max<size_t>(config_.batch_size_, 1);
+		if (config_.memory_budget_ != 0) {
+			budget_ = std::make_unique<MemoryBudget>(budget_cfg_t{ config_.memory_budget_ });
+		}
+
+		workers_.reserve(config_.workers_);
+		for (size_t i = 0; i < config_.workers_; ++i) {
+			auto& worker = workers_.emplace_back(std::make_unique<worker_t>());
+			worker->thread = std::thread{ [this, w = worker.get()] { run(*w); } };
+		}
+	}
+
+	ShardedProphet::~ShardedProphet() noexcept
+	{
+		for (auto& worker : workers_) {
+			submit(*worker);
+			{
+				std::lock_guard lock{ worker->mutex };
+				worker->stop = true;
+			}
+			worker->has_work.notify_one();
+		}
+
+		// a worker drains its queue before it stops
+		for (auto& worker : workers_) {
+			worker->thread.join();
+		}
+	}
+
+	[[nodiscard]] uint64_t ShardedProphet::shardOf(const blk_info_t& info) const noexcept
+	{
+		switch (config_.key_)
+		{
+		case shard_key_t::CPU:
+			return info.cpu();
+		case shard_key_t::LBA_REGION:
+			return info.lba() >> config_.region_bits_;
+		default:
+			return info.pid();
+		}
+	}
+
+	void ShardedProphet::insert(const blk_info_t& info)
+	{
+		const uint64_t shard = shardOf(info);
+		worker_t& worker = workerOf(shard);
+		worker.staged.push_back({ shard, info });
+
+		if (worker.staged.size() >= config_.batch_size_) {
+			submit(worker);
+		}
+	}
+
+	void ShardedProphet::insert_batch(std::span<const blk_info_t> infos)
+	{
+		for (const blk_info_t& info : infos) {
+			insert(info);
+		}
+	}
+
+	void ShardedProphet::flush()
+	{
+		for (auto& worker : workers_) {
+			submit(*worker);
+		}
+
+		for (auto& worker : workers_) {
+			std::unique_lock lock{ worker->mutex };
+			worker->is_idle.wait(lock, [&worker] {
+				return worker->queue.empty() && !worker->busy;
+			});
+
+			if (worker->error) {
+				std::rethrow_exception(std::exchange(worker->error, nullptr));
+			}
+		}
+	}
+
+	void ShardedProphet::setObserver(observer_t observer)
+	{
+		observer_ = std::move(observer);
+	}
+
+	[[nodiscard]] IOProphet::predict_pack_t ShardedProphet::predict(uint64_t shard) const
+	{
+		worker_t& worker = workerOf(shard);
+		std::lock_guard lock{ worker.prophets_mutex };
+
+		if (auto it = worker.prophets.find(shard); it != worker.prophets.cend()) {
+			return it->second.predict();
+		}
+
+		return {};
+	}
+
+	[[nodiscard]] std::vector<uint64_t> ShardedProphet::getShards() const
+	{
+		std::vector<uint64_t> result;
+		for (const auto& worker : workers_) {
+			std::lock_guard lock{ worker->prophets_mutex };
+			for (const auto& [shard, prophet] : worker->prophets) {
+				result.push_back(shard);
+			}
+		}
+
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	[[nodiscard]] size_t ShardedProphet::getWorkersCount() const noexcept
+	{
+		return workers_.size();
+	}
+
+	void ShardedProphet::rebalance()
+	{
+		if (!budget_) {
+			return;
+		}
+
+		flush();
+		std::vector<std::unique_lock<std::mutex>> locks;
+		locks.reserve(workers_.size());
+		for (auto& worker : workers_) {
+			locks.emplace_back(worker->prophets_mutex);
+		}
+
+		std::lock_guard lock{ budget_mutex_ };
+		budget_->rebalance();
+	}
+
+	void ShardedProphet::run(worker_t& worker)
+	{
+		std::vector<request_t> requests;
+
+		LOOP
+		{
+			{
+				std::unique_lock lock{ worker.mutex };
+				worker.busy = false;
+				if (worker.queue.empty()) {
+					worker.is_idle.notify_all();
+				}
+
+				worker.has_work.wait(lock, [&worker] {
+					return worker.stop || !worker.queue.empty();
+				});
+				if (worker.queue.empty()) {
+					return;
+				}
+
+				requests.swap(worker.queue);
+				worker.busy = true;
+			}
+
+			try {
+				std::lock_guard lock{ worker.prophets_mutex };
+				for (const request_t& request : requests) {
+					auto [it, inserted] = worker.prophets.try_emplace(request.shard, config_.prophet_);
+					if (inserted && budget_) {
+						std::lock_guard budget_lock{ budget_mutex_ };
+						budget_->attach(it->second);
+					}
+					if (observer_) {
+						observer_(request.shard, it->second, request.info);
+					}
+					it->second.insert(request.info);
+				}
+			}
+			catch (...) {
+				std::lock_guard lock{ worker.mutex };
+				if (!worker.error) {
+					worker.error = std::current_exception();
+				}
+			}
+
+			requests.clear();
+		}
+	}
+
+	void ShardedProphet::submit(worker_t& worker)
+	{
+		if (worker.staged.empty()) {
+			return;
+		}
+
+		{
+			std::lock_guard lock{ worker.mutex };
+			if (worker.queue.empty()) {
+				// the buffer of the last handed queue is reused for the next requests
+				worker.queue.swap(worker.staged);
+			}
+			else {
+				std::move(worker.staged.begin(), worker.staged.end(), std::back_inserter(worker.queue));
+			}
+		}
+
+		worker.staged.clear();
+		worker.has_work.notify_one();
+	}
+
+	ShardedProphet::worker_t& ShardedProphet::workerOf(uint64_t shard) const noexcept
+	{
+		return *workers_[utils::mix64(shard) % workers_.size()];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "model/stride_detector.hpp"
+#include <algorithm>
+
+namespace pIOn::model
+{
+	[[nodiscard]] int64_t StrideDetector::stream_t::step() const noexcept
+	{
+		return sequential ? static_cast<int64_t>(last_size / SECTOR_SIZE) : stride;
+	}
+
+	[[nodiscard]] uint64_t StrideDetector::stream_t::next() const noexcept
+	{
+		return last_lba + static_cast<uint64_t>(step());
+	}
+
+	StrideDetector::StrideDetector(size_t streams)
+		: streams_(streams)
+	{}
+
+	bool StrideDetector::observe(const blk_info_t& info)
+	{
+		if (streams_.empty()) {
+			return false;
+		}
+
+		++tick_;
+		// the time of a request is the gap since the previous one, the streams are timed by their sum
+		now_ += info.time();
+
+		auto follow = [this, &info](stream_t& stream) {
+			const double interval = now_ - stream.last_time;
+			stream.interval = stream.run <= 1 ? interval : INTERVAL_WEIGHT * interval + (1.0 - INTERVAL_WEIGHT) * stream.interval;
+			stream.last_lba = info.lba();
+			stream.last_size = info.size();
+			stream.last_time = now_;
+			stream.last_use = tick_;
+		};
+
+		for (stream_t& stream : streams_) {
+			if (stream.run != 0 && stream.op == info.type() && stream.next() == info.lba()) {
+				const bool established = stream.run >= MIN_RUN;
+				follow(stream);
+				++stream.run;
+				merge(stream);
+				return established;
+			}
+		}
+
+		// the second request of a stream gives its stride
+		if (stream_t* stream = nearest(info)) {
+			stream->stride = static_cast<int64_t>(info.lba() - stream->last_lba);
+			stream->sequential = stream->stride == static_cast<int64_t>(stream->last_size / SECTOR_SIZE);
+			stream->run = 1;
+			follow(*stream);
+			merge(*stream);
+			return false;
+		}
+
+		stream_t& stream = leastRecent();
+		stream = stream_t{};
+		stream.op = info.type();
+		follow(stream);
+		return false;
+	}
+
+	[[nodiscard]] blk_info_t StrideDetector::predict(const stream_t& stream, size_t steps) const noexcept
+	{
+		const int64_t distance = stream.step() * static_cast<int64_t>(steps);
+		const double time = std::max(0.0, stream.interval - (now_ - stream.last_time)) + stream.interval * static_cast<double>(steps - 1);
+
+		return BlkInfoBuilder{}
+			.setSector(stream.last_lba + static_cast<uint64_t>(distance))
+			.setSize(stream.last_size)
+			.setTime(time)
+			.setOp(stream.op)
+			.build();
+	}
+
+	[[nodiscard]] bool StrideDetector::enabled() const noexcept
+	{
+		return !streams_.empty();
+	}
+
+	[[nodiscard]] size_t StrideDetector::size() const noexcept
+	{
+		return static_cast<size_t>(std::count_if(streams_.cbegin(), streams_.cend(), [](const stream_t& stream) {
+			return stream.run >= MIN_RUN;
+		}));
+	}
+
+	[[nodiscard]] size_t StrideDetector::bytes() const noexcept
+	{
+		return streams_.capacity() * sizeof(stream_t);
+	}
+
+	void StrideDetector::clear() noexcept
+	{
+		std::fill(streams_.begin(), streams_.end(), stream_t{});
+	}
+
+	StrideDetector::stream_t* StrideDetector::nearest(const blk_info_t& info) noexcept
+	{
+		stream_t* result = nullptr;
+		uint64_t best = MAX_DISTANCE + 1;
+		for (stream_t& stream : streams_) {
+			if (stream.last_use == 0 || stream.run >= MIN_RUN || stream.op != info.type() || stream.last_lba == info.lba()) {
+				continue;
+			}
+
+			const uint64_t distance = std::max(stream.last_lba, info.lba()) - std::min(stream.last_lba, info.lba());
+			if (distance < best) {
+				best = distance;
+				result = &stream;
+			}
+		}
+
+		return result;
+	}
+
+	void StrideDetector::merge(stream_t& stream) noexcept
+	{
+		// a loop over a strided range starts a new stream on every pass, the old one is where the new one is
+		for (stream_t& other : streams_) {
+			if (&other != &stream && other.run != 0 && other.op == stream.op
+				&& other.last_lba == stream.last_lba && other.step() == stream.step())
+			{
+				stream.run = std::max(stream.run, other.run);
+				other = stream_t{};
+			}
+		}
+	}
+
+	StrideDetector::stream_t& StrideDetector::leastRecent() noexcept
+	{
+		return *std::min_element(streams_.begin(), streams_.end(), [](const stream_t& lhs, const stream_t& rhs) {
+			return lhs.last_use < rhs.last_use;
+		});
+	}
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <algorithm>
 #include "predictor.hpp"
 
 namespace pIOn::sequitur {
@@ -25,67 +26,369 @@ namespace pIOn::sequitur {
 			rules_set_ = std::move(other.rules_set_);
 			predictions_ = std::move(other.predictions_);
 			index_ = std::move(other.index_);
+			occurrences_ = std::move(other.occurrences_);
 			rules_ = std::move(other.rules_);
 			rule_idx_ = std::exchange(other.rule_idx_, 0ULL);
+			symbols_count_ = std::exchange(other.symbols_count_, 0ULL);
 			version_ = std::exchange(other.version_, 0ULL);
 			limit_ = std::exchange(other.limit_, ~0ULL);
+			policy_ = std::exchange(other.policy_, limit_policy_t::RESET);
 		}
 
 		return *this;
 	}
 
-	Predictor::~Predictor() = default;
+	Predictor::~Predictor()
+	{
+		if (axiom_) {
+			discard();
+		}
+	}
+
+	// Every object is destroyed in place, nothing is unlinked or returned to the pools one by one:
+	// the pools take all the slots back at once and keep the chunks for the next grammar
+	void Predictor::discard() noexcept
+	{
+		for (Rules* r : rules_set_) {
+			for (Symbols* s = r->guard_->next_; s != r->guard_;) {
+				Symbols* next = s->next_;
+				std::destroy_at(s);
+				s = next;
+			}
+			std::destroy_at(r->guard_);
+			std::destroy_at(&r->users_); // the rest of Rules is trivially destructible
+		}
+		std::destroy_at(root_);
+
+		rules_set_.clear();
+		rulesPool.reset();
+		symbolsPool.reset();
+	}
 
-	void Predictor::clearSpace() noexcept
+	void Predictor::setHugePages(bool huge_pages) noexcept
 	{
-		rulesPool.freeSpace();
-		symbolsPool.freeSpace();
+		rulesPool.setHugePages(huge_pages);
+		symbolsPool.setHugePages(huge_pages);
 	}
 
 	bool Predictor::checkLimits()
 	{
-		if (auto sz = size(); sz < limit_) {
+		return trim(limit_);
+	}
+
+	bool Predictor::trim(size_t limit)
+	{
+		if (auto sz = size(); sz < limit) {
 			return true;
 		}
 
-		root_->release();
-		deallocate(root_);
-		deallocate(axiom_);
+		++version_;
+		if (policy_ == limit_policy_t::EVICT) {
+			while (size() >= limit && !axiom_->empty()) {
+				evict_oldest();
+			}
+			return true;
+		}
+
+		reset();
+		return false;
+	}
+
+	void Predictor::reset()
+	{
+		discard();
 
-		rules_set_.clear();
 		predictions_.clear();
 		index_.clear();
+		occurrences_.clear();
 		rules_.clear();
 		rule_idx_ = version_ = 0ULL;
-
-		clearSpace();
+		symbols_count_ = 0;
 
 		axiom_ = allocateRule(this);
 		root_ = allocateSymbol(axiom_);
-
-		return false;
 	}
 
 	void Predictor::setLimits(size_t limit)
 	{
 		limit_ = limit;
+		// every symbol starts at most one digram, so the limit bounds the index size
+		index_.reserve(std::min(limit, INDEX_PRESIZE_LIMIT));
+	}
+
+	void Predictor::setLimitPolicy(limit_policy_t policy) noexcept
+	{
+		policy_ = policy;
+	}
+
+	// The oldest symbol of the input leaves the axiom. The rules that are used only in
+	// the old input lose their last user and are deleted, the rules that are still used
+	// elsewhere (hot ones) stay. The work is proportional to the amount of forgotten symbols.
+	// Rules left with a single user are not inlined: that would join digrams that are not
+	// in the index, while keeping them costs one symbol.
+	void Predictor::evict_oldest()
+	{
+		forget(axiom_->first());
+
+		while (!evicted_rules_.empty()) {
+			Rules* r = evicted_rules_.back();
+			evicted_rules_.pop_back();
+
+			while (!r->first()->is_guard()) {
+				forget(r->first());
+			}
+			deallocate(r);
+		}
+	}
+
+	void Predictor::forget(Symbols* s)
+	{
+		Rules* r = s->nt() ? s->rule() : nullptr;
+		s->drop_predictors();
+		s->release().self_delete();
+
+		if (r && r->freq() == 0) {
+			evicted_rules_.push_back(r);
+		}
+	}
+
+	void Predictor::save(utils::SnapshotWriter& writer) const
+	{
+		// handles are given in the order of rules_set_, the axiom and the root go first
+		std::vector<Rules*> rules{ nullptr, axiom_ };
+		std::vector<Symbols*> symbols{ nullptr, root_ };
+		utils::FlatMap<uint64_t, uint32_t> rule_handles, symbol_handles;
+		auto address = [](const void* ptr) { return reinterpret_cast<uint64_t>(ptr); };
+
+		for (Rules* r : rules_set_) {
+			if (r != axiom_) {
+				rules.push_back(r);
+			}
+		}
+
+		rule_handles.reserve(rules.size());
+		symbol_handles.reserve(symbols_count_ + 2 * rules.size());
+		for (uint32_t r = 1; r < rules.size(); ++r) {
+			rule_handles[address(rules[r])] = r;
+			symbols.push_back(rules[r]->guard_);
+			for (Symbols* s = rules[r]->first(); !s->is_guard(); s = s->next()) {
+				symbols.push_back(s);
+			}
+		}
+		for (uint32_t s = 1; s < symbols.size(); ++s) {
+			symbol_handles[address(symbols[s])] = s;
+		}
+
+		auto handle = [&symbol_handles, &address](const Symbols* s) { return s ? *symbol_handles.find(address(s)) : 0U; };
+
+		std::vector<snapshot::symbol_t> symbol_records(symbols.size());
+		std::vector<snapshot::rule_t> rule_records(rules.size());
+		std::vector<snapshot::predictor_t> predictors;
+		std::vector<uint32_t> predictions, digrams;
+
+		for (uint32_t r = 1; r < rules.size(); ++r) {
+			rule_records[r] = snapshot::rule_t{ handle(rules[r]->guard_), static_cast<uint32_t>(rules[r]->length_) };
+		}
+
+		for (uint32_t h = 1; h < symbols.size(); ++h) {
+			Symbols* s = symbols[h];
+			snapshot::symbol_t& record = symbol_records[h];
+			record.sym = s->nt() ? *rule_handles.find(address(s->rule())) : s->get_symbol();
+			record.next = handle(s->next_);
+			record.prev = handle(s->prev_);
+			record.owner = s->owner_ ? *rule_handles.find(address(s->owner_)) : 0U;
+			record.flags = (s->nt() ? 0 : snapshot::TERMINAL) | (s->is_pred() ? snapshot::PREDICTOR : 0);
+
+			for (Symbols* child : s->predictors_) {
+				predictors.push_back({ h, handle(child) });
+			}
+		}
+
+		for (Symbols* s : predictions_) {
+			predictions.push_back(handle(s));
+		}
+		index_.for_each([&digrams, &handle](Symbols* s) {
+			digrams.push_back(handle(s));
+		});
+
+		snapshot::write(writer, snapshot::grammar_t{ 1, 1, symbol_records, rule_records, {}, {}, predictors, predictions, digrams });
+	}
+
+	void Predictor::load(utils::SnapshotReader& reader)
+	{
+		const snapshot::grammar_t g = snapshot::read(reader);
+		const uint64_t version = version_;
+		reset();
+
+		std::vector<Rules*> rules(g.rules.size(), nullptr);
+		std::vector<Symbols*> symbols(g.symbols.size(), nullptr);
+		rules[g.axiom] = axiom_;
+		symbols[g.root] = root_;
+
+		for (uint32_t r = 1; r < g.rules.size(); ++r) {
+			if (g.rules[r].guard != 0 && r != g.axiom) {
+				rules[r] = allocateRule(this);
+			}
+		}
+
+		// non-terminals register themselves as the users of their rules
+		for (uint32_t r = 1; r < g.rules.size(); ++r) {
+			if (rules[r] == nullptr) {
+				continue;
+			}
+
+			const uint32_t guard = g.rules[r].guard;
+			symbols[guard] = rules[r]->guard_;
+			for (uint32_t s = g.symbols[guard].next; s != guard; s = g.symbols[s].next) {
+				const snapshot::symbol_t& record = g.symbols[s];
+				symbols[s] = (record.flags & snapshot::TERMINAL)
+					? allocateSymbol(record.sym, rules[r])
+					: allocateSymbol(rules[record.sym], rules[r]);
+			}
+		}
+
+		for (uint32_t s = 1; s < g.symbols.size(); ++s) {
+			Symbols* sym = symbols[s];
+			if (sym == nullptr) {
+				continue;
+			}
+
+			sym->next_ = symbols[g.symbols[s].next];
+			sym->prev_ = symbols[g.symbols[s].prev];
+			sym->is_predictor_ = g.symbols[s].flags & snapshot::PREDICTOR;
+			if (sym != root_ && !sym->is_guard()) {
+				link_occurrence(sym);
+			}
+		}
+
+		for (uint32_t r = 1; r < g.rules.size(); ++r) {
+			if (rules[r]) {
+				rules[r]->length_ = g.rules[r].length;
+				symbols_count_ += g.rules[r].length;
+			}
+		}
+
+		for (const snapshot::predictor_t& p : g.predictors) {
+			symbols[p.holder]->predictors_.insert(symbols[p.child]);
+		}
+		for (uint32_t s : g.predictions) {
+			add_prediction(symbols[s]);
+		}
+
+		index_.reserve(std::max<size_t>(g.digrams.size(), std::min(limit_, INDEX_PRESIZE_LIMIT)));
+		for (uint32_t s : g.digrams) {
+			set_digram(symbols[s]);
+		}
+
+		version_ = version + 1;
 	}
 
 	void Predictor::find_new_predictors(Symbols* s)
 	{
-		for (auto it = rules_set_.begin(); it != rules_set_.end(); ++it) {
-			Rules* r = *it;
-			r->first()->find_potential_predictors(s);
+		// only the earlier occurrences of s can become predictors, no need to scan every rule
+		Symbols* const* head = occurrences_.find(s->get_symbol());
+		for (Symbols* p = head ? *head : nullptr; p != nullptr; p = p->next_occurrence_) {
+			p->find_potential_predictors(s);
+		}
+	}
+
+	void Predictor::link_occurrence(Symbols* s)
+	{
+		Symbols*& head = occurrences_[s->get_symbol()];
+		s->prev_occurrence_ = nullptr;
+		s->next_occurrence_ = head;
+		if (head) {
+			head->prev_occurrence_ = s;
+		}
+		head = s;
+	}
+
+	void Predictor::unlink_occurrence(Symbols* s) noexcept
+	{
+		if (s->prev_occurrence_) {
+			s->prev_occurrence_->next_occurrence_ = s->next_occurrence_;
+		}
+		else {
+			Symbols** head = occurrences_.find(s->get_symbol());
+			if (head == nullptr || *head != s) {
+				return; // not linked
+			}
+
+			if (s->next_occurrence_) {
+				*head = s->next_occurrence_;
+			}
+			else {
+				occurrences_.erase(s->get_symbol());
+			}
+		}
+
+		if (s->next_occurrence_) {
+			s->next_occurrence_->prev_occurrence_ = s->prev_occurrence_;
 		}
+		s->next_occurrence_ = s->prev_occurrence_ = nullptr;
 	}
 
 	bool Predictor::insert(uint64_t x) {
 		bool is_limits = checkLimits();
 		++version_;
+		append(x, true);
+		return is_limits;
+	}
+
+	bool Predictor::insert_batch(std::span<const uint64_t> xs, bool predict_last_only)
+	{
+		bool is_limits = true;
+		if (predict_last_only) {
+			clear_predictors(root_);
+			predictions_.clear();
+		}
+
+		// a symbol grows the grammar by one at most, so the limits are checked only
+		// when the batch could reach them
+		size_t headroom = 0;
+		for (size_t i = 0; i < xs.size(); ++i) {
+			if (headroom == 0) {
+				is_limits &= checkLimits();
+				// over a limit that could not be met the check is repeated on every symbol
+				headroom = size() < limit_ ? limit_ - size() : 1;
+			}
+			--headroom;
+
+			const bool last = i + 1 == xs.size();
+			if (predict_last_only && last) {
+				predictions_.clear(); // nothing predicted inside the batch is valid
+			}
+			append(xs[i], !predict_last_only || last);
+		}
+
+		++version_;
+		return is_limits;
+	}
+
+	// Forgets every predictor below s, the grammar itself is not touched
+	void Predictor::clear_predictors(Symbols* s)
+	{
+		if (!s->is_predictor_) {
+			return;
+		}
+
+		s->is_predictor_ = false;
+		for (Symbols* child : s->predictors_) {
+			clear_predictors(child);
+		}
+		s->predictors_.clear();
+	}
 
+	void Predictor::append(uint64_t x, bool predict)
+	{
 		Symbols* s = allocateSymbol(x, axiom_);
 		axiom_->last()->insert_after(s);
 
+		if (!predict) {
+			axiom_->last()->prev()->check();
+			return;
+		}
+
 		root_->compute_next_predictors(s);
 		root_->update_predictors();
 		axiom_->last()->prev()->check();
@@ -95,8 +398,6 @@ namespace pIOn::sequitur {
 			root_->compute_next_predictors(s);
 			root_->update_predictors();
 		}
-
-		return is_limits;
 	}
 
 	std::list<uint64_t> Predictor::predict_next() const {
@@ -115,72 +416,59 @@ namespace pIOn::sequitur {
 	}
 
 	Symbols* Predictor::find_digram(Symbols* s) {
-		std::pair<uint64_t, uint64_t> key(s->get_symbol(), s->next()->get_symbol());
-
-		if (auto iter = index_.find(std::move(key)); iter != index_.end()) {
-			return iter->second;
-		}
-		else {
-			return nullptr;
-		}
+		return index_.find(s->get_symbol(), s->next()->get_symbol());
 	}
 
 	void Predictor::delete_digram(Symbols* s) {
-		std::pair<uint64_t, uint64_t> key(s->get_symbol(), s->next()->get_symbol());
-
-		if (auto iter = index_.find(std::move(key)); iter != index_.end() && iter->second == s) {
-			index_.erase(iter);
-		}
+		index_.erase(s->get_symbol(), s->next()->get_symbol(), s);
 	}
 
 	void Predictor::set_digram(Symbols* s) {
-		std::pair<uint64_t, uint64_t> key(s->get_symbol(), s->next()->get_symbol());
-		index_[std::move(key)] = s;
+		index_.assign(s->get_symbol(), s->next()->get_symbol(), s);
 	}
 
 	size_t Predictor::size() const {
-		size_t size{ };
-		for (auto rule = rules_set_.begin(); rule != rules_set_.end(); ++rule) {
-			size += (*rule)->length();
-		}
-		return size;
+		// same as the sum of Rules::length(), where an empty axiom counts as one
+		return symbols_count_ + (axiom_->empty() ? 1 : 0);
 	}
 
-	std::list<std::stack<Symbols*>> Predictor::build_predictor_stack_from(Symbols* s) const
-	{
-		std::list<std::stack<Symbols*>> result;
-
-		if (!s->nt()) {
-			std::stack<Symbols*> st;
-			st.push(s);
-			result.push_back(st);
-			return result;
-		}
-
-		s = s->rule()->first();
-		while (!s->is_guard()) {
-			if (s->is_pred()) {
-				auto stacks = build_predictor_stack_from(s);
+	grammar_stats_t Predictor::stats() const {
+		return grammar_stats_t{ symbols_count_, rules_set_.size(), index_.size(), predictions_.size() };
+	}
 
-				for (auto it = stacks.begin(); it != stacks.end(); ++it) {
-					auto st = *it;
-					st.push(s);
-					result.push_back(st);
-				}
+	memory_usage_t Predictor::memory_usage() const {
+		memory_usage_t result;
+		result.symbols = symbolsPool.bytes();
+		result.rules = rulesPool.bytes() + rules_set_.size() * tree_node_bytes<Rules*>;
+		result.digram_index = index_.bytes();
+		result.occurrences = occurrences_.bytes();
+		result.predictions = predictions_.size() * tree_node_bytes<Symbols*>;
+		result.other = (rules_.capacity() + evicted_rules_.capacity()) * sizeof(Rules*);
+
+		auto add_sets = [&result](const Symbols* s) {
+			result.predictor_sets += s->predictors_.heap_bytes() + s->next_new_predictor_.heap_bytes() + s->next_stay_predictor_.heap_bytes();
+		};
+		for (const Rules* r : rules_set_) {
+			result.users_sets += r->users_.heap_bytes();
+			for (const Symbols* s = r->guard_->next_; s != r->guard_; s = s->next_) {
+				add_sets(s);
 			}
-			s = s->next();
 		}
+		add_sets(root_);
+
 		return result;
 	}
 
+	size_t Predictor::footprint() const noexcept {
+		return symbolsPool.live_bytes() + rulesPool.live_bytes() + rules_set_.size() * tree_node_bytes<Rules*>
+			+ index_.live_bytes() + occurrences_.live_bytes() + predictions_.size() * tree_node_bytes<Symbols*>;
+	}
+
 	std::list<Predictor::iterator> Predictor::predict_all() const {
-		auto stacks = build_predictor_stack_from(root_);
 		std::list<Predictor::iterator> result;
-
-		for (auto it = stacks.begin(); it != stacks.end(); ++it) {
-			Predictor::iterator iter(this, *it);
-			result.push_back(std::move(iter));
-		}
+		for_each_cursor([this, &result](const cursor& c) {
+			result.push_back(Predictor::iterator(this, c));
+		});
 
 		return result;
 	}
@@ -246,6 +534,14 @@ namespace pIOn::sequitur {
 		}
 	}
 
+	Predictor::iterator::iterator(const Predictor* p, const cursor& c)
+		: iterator(p)
+	{
+		for (size_t i = 0; i < c.depth_; ++i) {
+			stack.push(c.path_[i]);
+		}
+	}
+
 	Predictor::iterator::iterator(const Predictor::iterator& other) {
 		stack = other.stack;
 		version = other.version;
@@ -330,4 +626,70 @@ namespace pIOn::sequitur {
 	bool Predictor::iterator::operator!=(const Predictor::iterator& it) {
 		return !(stack == it.stack);
 	}
-}
+
+	uint64_t Predictor::cursor::operator*() const
+	{
+		check();
+		return done() ? 0 : path_[depth_ - 1]->get_symbol();
+	}
+
+	Predictor::cursor& Predictor::cursor::operator++()
+	{
+		check();
+		while (depth_ != 0) {
+			// continue reading the innermost rule, or leave it when it is read
+			Symbols* s = path_[depth_ - 1]->next();
+			if (s->is_guard()) {
+				--depth_;
+				continue;
+			}
+
+			path_[depth_ - 1] = s;
+			while (s->nt()) {
+				s = s->rule()->first();
+				push(s);
+			}
+			break;
+		}
+
+		return *this;
+	}
+
+	size_t Predictor::cursor::advance(size_t steps)
+	{
+		size_t made = 0;
+		for (; made < steps && !done(); ++made) {
+			++(*this);
+		}
+
+		return made;
+	}
+
+	size_t Predictor::cursor::read(std::span<uint64_t> out)
+	{
+		size_t count = 0;
+		for (; count < out.size() && !done(); ++count) {
+			out[count] = **this;
+			++(*this);
+		}
+
+		return count;
+	}
+
+	void Predictor::cursor::push(Symbols* s) noexcept
+	{
+		if (depth_ == MAX_DEPTH) {
+			std::move(path_.begin() + 1, path_.end(), path_.begin());
+			--depth_;
+			truncated_ = true;
+		}
+		path_[depth_++] = s;
+	}
+
+	void Predictor::cursor::check() const
+	{
+		if (parent_ == nullptr || version_ != parent_->version_) {
+			throw invalid_cursor();
+		}
+	}
+}
\ No newline at end of file
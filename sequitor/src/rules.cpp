@@ -50,11 +50,13 @@ namespace pIOn::sequitur {
 		}
 	}
 
+	// An empty rule counts as one symbol, only the axiom can be empty between inserts
 	size_t Rules::length() const {
-		size_t size = 1;
-		for (Symbols* s = first(); s != last(); s = s->next()) {
-			++size;
-		}
-		return size;
+		return length_ ? length_ : 1;
+	}
+
+	void Rules::resize(int64_t delta) noexcept {
+		length_ += delta;
+		predictor_->symbols_count_ += delta;
 	}
 }
@@ -9,6 +9,7 @@
 #include "symbols.hpp"
 #include "predictor.hpp"
 #include <stack>
+#include <algorithm>
 #include <cassert>
 
 std::ostream& operator<<(std::ostream& out, pIOn::sequitur::Symbols& s) {
@@ -36,6 +37,14 @@ namespace pIOn::sequitur {
 		owner_ = o;
 	}
 
+	void Symbols::insert_after(Symbols* y)
+	{
+		join(y, next_);
+		join(this, y);
+		owner_->resize(1);
+		owner_->get_predictor()->link_occurrence(y);
+	}
+
 	Symbols& Symbols::release()
 	{
 		if (prev_ == nullptr && next_ == nullptr) {
@@ -47,6 +56,8 @@ namespace pIOn::sequitur {
 		join(prev_, next_);
 
 		if (!is_guard()) {
+			owner_->resize(-1);
+			owner_->get_predictor()->unlink_occurrence(this);
 			delete_digram();
 			if (nt()) {
 				rule()->deuse(this);
@@ -123,9 +134,13 @@ namespace pIOn::sequitur {
 		}
 		ns->owner_ = owner_;
 
+		// symbols move to the owner, the grammar total does not change
+		owner_->length_ += rule()->length_;
+
 		delete_digram();
 
 		Predictor* pred = owner_->get_predictor();
+		pred->unlink_occurrence(this);
 		pred->deallocate(rule());
 		sym_ = 0;
 		release().self_delete();
@@ -337,6 +352,43 @@ namespace pIOn::sequitur {
 		}
 	}
 
+	void Symbols::drop_predictors() {
+		if (!is_predictor_) {
+			return;
+		}
+
+		is_predictor_ = false;
+		if (owner_) {
+			if (!nt()) {
+				owner_->get_predictor()->remove_prediction(this);
+			}
+
+			// only the users of the owner can hold this symbol as a predictor
+			auto& users = owner_->get_users();
+			for (auto user = users.begin(); user != users.end(); ++user) {
+				(*user)->predictors_.erase(this);
+			}
+		}
+
+		if (!nt()) {
+			predictors_.clear();
+			return;
+		}
+
+		// the nested predictors stay if another user of the rule holds them
+		predictors_set_t children = std::move(predictors_);
+		auto& users = rule()->get_users();
+		for (auto it = children.begin(); it != children.end(); ++it) {
+			Symbols* child = *it;
+			bool held = std::any_of(users.begin(), users.end(), [this, child](Symbols* user) {
+				return user != this && user->predictors_.contains(child);
+			});
+			if (!held) {
+				child->drop_predictors();
+			}
+		}
+	}
+
 	inline void Symbols::process_matching(Symbols* matching)
 	{
 		for (auto it = predictors_.begin(); it != predictors_.end(); ++it) {
@@ -451,19 +503,15 @@ namespace pIOn::sequitur {
 	}
 
 	void Symbols::find_potential_predictors(Symbols* matching) {
+		// prevents from using the last symbol of the rule, which will disappear anyway
+		if (this == matching || next_->is_guard() || !owner_) {
+			return;
+		}
 
-		for (Symbols* sym_ptr = this; sym_ptr != matching && !sym_ptr->next()->is_guard(); sym_ptr = sym_ptr->next())
-		{
-			// prevents from using the last symbol of the rule, which will disappear anyway
-			if (sym_ptr->get_symbol() == matching->get_symbol()) {
-				if (owner_) {
-					become_predictor_down_right();
-					auto& users = owner_->get_users();
-					for (auto user = users.begin(); user != users.end(); ++user) {
-						(*user)->become_predictor_up(sym_ptr);
-					}
-				}
-			}
+		owner_->first()->become_predictor_down_right();
+		auto& users = owner_->get_users();
+		for (auto user = users.begin(); user != users.end(); ++user) {
+			(*user)->become_predictor_up(this);
 		}
 	}
 
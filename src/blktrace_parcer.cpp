@@ -181,6 +181,8 @@ namespace pIOn
 			             .setSize(delta_size)
 			             .setTime(delta_time)
 			             .setOp(r ? 0 : 1)
+			             .setPid(blk_line.pid)
+			             .setCpu(blk_line.cpu)
 			             .build();
 
 		time_prev_ = time_cur;
@@ -37,7 +37,21 @@ namespace nlohmann
                 j.at("verbose"),
                 j.at("delta"),
                 j.at("type_based"),
-                type };
+                type,
+                j.value("compact_grammar", false),
+                j.value("evict_rules", false),
+                j.value("shard_by", std::string{ "none" }),
+                j.value("shard_workers", 0U),
+                j.value("memory_limit", uint64_t{ 0 }),
+                j.value("memory_budget", uint64_t{ 0 }),
+                j.value("engine", std::string{ "sequitur" }),
+                j.value("context_order", 2U),
+                j.value("stride_streams", 0U),
+                j.value("key", std::string{ "standart" }),
+                j.value("region_levels", std::vector<uint64_t>{}),
+                j.value("region_readahead", uint64_t{ 1ULL << 20 }),
+                j.value("factorized", false),
+                j.value("time_table_limit", int64_t{ -1 }) };
         }
 
         static void to_json(json& j, const pIOn::Config& p)
@@ -59,6 +73,20 @@ namespace nlohmann
             j["delta"] = p.delta;
             j["type_based"] = p.type_based;
             j["type"] = p.type;
+            j["compact_grammar"] = p.compact_grammar;
+            j["evict_rules"] = p.evict_rules;
+            j["shard_by"] = p.shard_by;
+            j["shard_workers"] = p.shard_workers;
+            j["memory_limit"] = p.memory_limit;
+            j["memory_budget"] = p.memory_budget;
+            j["engine"] = p.engine;
+            j["context_order"] = p.context_order;
+            j["stride_streams"] = p.stride_streams;
+            j["key"] = p.key;
+            j["region_levels"] = p.region_levels;
+            j["region_readahead"] = p.region_readahead;
+            j["factorized"] = p.factorized;
+            j["time_table_limit"] = p.time_table_limit;
         }
     };
 } // namespace nlohmann
@@ -95,6 +123,28 @@ namespace pIOn
         if (config.type != 0 && config.type != 1) {
             throw std::runtime_error{ "incorect config data for operation type code: nor 0 no 1" };
         }
+
+        if (config.shard_by != "none" && config.shard_by != "pid" && config.shard_by != "cpu" && config.shard_by != "lba") {
+            throw std::runtime_error{ "incorect config data for shard_by: nor none, pid, cpu no lba" };
+        }
+
+        if (config.engine != "sequitur" && config.engine != "markov" && config.engine != "ppm") {
+            throw std::runtime_error{ "incorect config data for engine: nor sequitur, markov no ppm" };
+        }
+
+        if (config.engine != "sequitur" && (config.context_order == 0 || config.context_order > 8)) {
+            throw std::runtime_error{ "incorect config data for context_order: must be from 1 to 8" };
+        }
+
+        if (config.key != "standart" && config.key != "delta" && config.key != "interned" && config.key != "sector" && config.key != "offset") {
+            throw std::runtime_error{ "incorect config data for key: nor standart, delta, interned, sector no offset" };
+        }
+
+        for (size_t i = 0; i < config.region_levels.size(); ++i) {
+            if (config.region_levels[i] % 512 != 0 || (i > 0 && config.region_levels[i] <= config.region_levels[i - 1])) {
+                throw std::runtime_error{ "incorect config data for region_levels: must be growing multiples of 512" };
+            }
+        }
     }
 
     std::ostream& operator<<(std::ostream& o, const Config& config) noexcept
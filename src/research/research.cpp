@@ -8,8 +8,10 @@
 #include <algorithm>
 #include <numeric>
 #include <sstream>
+#include <atomic>
 
 #include "model/io_prophet.hpp"
+#include "model/sharded_prophet.hpp"
 #include "blktrace_parser.hpp"
 #include "cyclic_buffer.hpp"
 #include "jdtests/timer.hpp"
@@ -38,7 +40,7 @@ namespace pIOn
 
 		for (const auto& item : pack) {
 			// Predicted offset and size
-			const size_t p_off{ item.first.lba() }, p_size{ item.first.size() };
+			const size_t p_off{ item.info_.lba() }, p_size{ item.info_.size() };
 			const size_t p_start = p_size != 0 ? std::min(p_off, offset) : offset;
 			const size_t p_end = p_size != 0 ? std::max(p_off + p_size, offset + size) : (offset + size);
 
@@ -74,9 +76,9 @@ namespace pIOn
 		for (auto&& item : pack) {
 			// Predicted offset and size
 			const size_t factor_x_size{ factor * size };
-			const bool prolongation{ item.first.lba() > factor_x_size };
-			const size_t lba{ prolongation ? item.first.lba() - factor_x_size : item.first.lba() };
-			const size_t p_off{ lba }, p_size{ prolongation ? item.first.size() * (factor * 2ull + 1ull) : item.first.size() };
+			const bool prolongation{ item.info_.lba() > factor_x_size };
+			const size_t lba{ prolongation ? item.info_.lba() - factor_x_size : item.info_.lba() };
+			const size_t p_off{ lba }, p_size{ prolongation ? item.info_.size() * (factor * 2ull + 1ull) : item.info_.size() };
 
 			if (p_off <= offset && p_off + p_size >= size + offset) {
 				hit_ratio += 100.0;
@@ -125,13 +127,72 @@ namespace pIOn
 	static bool is_pack_predicted(const model::IOProphet::predict_pack_t& pack, const blk_info_t& blk_info)
 	{
 		auto it = std::find_if(pack.cbegin(), pack.cend(), [&blk_info](const auto& item) {
-			const auto& blk = item.first;
+			const auto& blk = item.info_;
 		    return blk_info.type() == blk.type() && blk_info.size() == blk.size() && blk_info.lba() == blk.lba();
 		});
 
 		return it != pack.cend();
 	}
 
+	// Requests between the rebalances of the memory budget of the streams
+	static constexpr uint64_t REBALANCE_PERIOD = 50'000;
+
+	// A prophet per stream, the streams are trained in parallel during one pass over the trace
+	static void makeShardedResearch(BLKParser& parser, const Config& config, const model::prophet_cfg_t& prophet_config)
+	{
+		model::sharded_cfg_t sharded_config;
+		sharded_config.prophet_ = prophet_config;
+		sharded_config.workers_ = config.shard_workers;
+		sharded_config.memory_budget_ = static_cast<size_t>(config.memory_budget);
+		sharded_config.key_ = config.shard_by == "cpu" ? model::shard_key_t::CPU
+			: config.shard_by == "lba" ? model::shard_key_t::LBA_REGION : model::shard_key_t::PID;
+
+		model::ShardedProphet prophet{ sharded_config };
+		std::atomic<uint64_t> pred_count{ 0 }, total_pred_count{ 0 };
+		// the request is checked against the predictions of its stream made before it
+		prophet.setObserver([&pred_count, &total_pred_count](uint64_t, const model::IOProphet& shard, const blk_info_t& info) {
+			const auto predictions = shard.predict();
+			if (!predictions.empty()) {
+				total_pred_count.fetch_add(1, std::memory_order_relaxed);
+			}
+			if (is_pack_predicted(predictions, info)) {
+				pred_count.fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		jd::timer::Timer clock;
+		uint64_t iops = 0;
+		clock.start();
+		for (; iops < config.max_cmd; ++iops) {
+			if (auto maybe_info = parser.parse_next(); maybe_info) {
+				prophet.insert(*maybe_info);
+			}
+			else {
+				std::cout << "\nDone before right limit!" << std::endl;
+				break;
+			}
+
+			if ((iops + 1) % REBALANCE_PERIOD == 0) {
+				prophet.rebalance();
+			}
+		}
+		prophet.flush();
+		clock.stop();
+
+		prophet.for_each([&config](uint64_t shard, const model::IOProphet& stream) {
+			std::cout << config.shard_by << "=" << shard << ": grammar size = " << stream.getGrammarSize() << '\n';
+		});
+
+		std::cout << "\n\nAll operations: " << iops
+			<< "\nstreams: " << prophet.getShards().size()
+			<< "\nworkers: " << prophet.getWorkersCount()
+			<< "\ntotal predictions: " << total_pred_count.load()
+			<< "\nwith full match: " << pred_count.load()
+			<< "\ntime: " << std::fixed << std::setprecision(6) << clock.time() << std::endl;
+
+		std::cout << "\n\nResearch done!" << std::endl;
+	}
+
 	void makeResearch(const Config& config)
 	{
 		std::cout << "Starting research with: delta=" << std::boolalpha << config.delta << std::endl;
@@ -187,7 +248,26 @@ namespace pIOn
 		// Predictions that made at the end of last op
 		CyclicBuffer<10ULL> cyclic_buffer{};
 		model::IOProphet::predict_pack_t _predictions_; 
-		model::IOProphet prophet{ model::prophet_cfg_t{config.max_grammar_size} };
+		model::prophet_cfg_t prophet_config;
+		prophet_config.grammar_limits_ = config.max_grammar_size;
+		prophet_config.storage_ = config.compact_grammar ? model::grammar_storage_t::COMPACT : model::grammar_storage_t::LINKED;
+		prophet_config.limit_policy_ = config.evict_rules ? sequitur::limit_policy_t::EVICT : sequitur::limit_policy_t::RESET;
+		prophet_config.memory_limit_ = static_cast<size_t>(config.memory_limit);
+		prophet_config.engine_ = config.engine == "markov" ? engines::engine_t::MARKOV
+			: config.engine == "ppm" ? engines::engine_t::PPM : engines::engine_t::SEQUITUR;
+		prophet_config.context_order_ = config.context_order;
+		prophet_config.stride_streams_ = config.stride_streams;
+		prophet_config.key_ = config.key == "delta" ? model::key_function_t::DELTA
+			: config.key == "interned" ? model::key_function_t::INTERNED
+			: config.key == "sector" ? model::key_function_t::SECTOR
+			: config.key == "offset" ? model::key_function_t::OFFSET : model::key_function_t::STANDART;
+		prophet_config.region_levels_ = config.region_levels;
+		prophet_config.region_readahead_ = config.region_readahead;
+		prophet_config.factorized_ = config.factorized;
+		if (config.time_table_limit >= 0) {
+			prophet_config.time_table_limit_ = static_cast<size_t>(config.time_table_limit);
+		}
+		model::IOProphet prophet{ prophet_config };
 		jd::timer::Timer clock;
 
 		for (size_t i = 0; i < config.start && parser.need_io(); ++i) {
@@ -199,6 +279,11 @@ namespace pIOn
 			return;
 		}
 
+		if (config.shard_by != "none") {
+			makeShardedResearch(parser, config, prophet_config);
+			return;
+		}
+
 		blk_info_t blk_info;
 		if (auto maybe_info = parser.parse_next(); maybe_info) {
 			blk_info = *maybe_info;
@@ -246,7 +331,7 @@ namespace pIOn
 			}
 
 			for (size_t idx = 1ULL; idx < _predictions_.size(); ++idx) {
-				cyclic_buffer.push(idx, _predictions_[idx].first);
+				cyclic_buffer.push(idx, _predictions_[idx].info_);
 			}
 
 			_total_pred_count_ += !_predictions_.empty();
@@ -265,7 +350,7 @@ namespace pIOn
 
 			// Prediction of the size
 			real pred_size_avg = std::accumulate(_predictions_.cbegin(), _predictions_.cend(), 0.0, [](real init, const auto& item) {
-				return init + static_cast<real>(item.first.size());
+				return init + static_cast<real>(item.info_.size());
 				});
 			if (!_predictions_.empty()) {
 				pred_size_avg /= _predictions_.size();
@@ -279,7 +364,7 @@ namespace pIOn
 			// Prediction of offset
 			std::multiset<size_t> proposed_offsets;
 			for (auto it = _predictions_.begin(); it != _predictions_.end(); ++it) {
-				size_t off{it->first.lba()};
+				size_t off{it->info_.lba()};
 				proposed_offsets.insert(off);
 			}
 
@@ -297,15 +382,16 @@ namespace pIOn
 			is_predicted = is_predicted ? is_predicted : hit_ratio >= config.hit_precentage;
 
 			// Time results
-			real p_time = !_predictions_.empty() ? _predictions_.front().first.time() : 0.0;
+			real p_time = !_predictions_.empty() ? _predictions_.front().info_.time() : 0.0;
 			real real_timestamp{ std::abs(blk_info.time() - _previous_time_) };
 			real pred_timestamp{ std::abs(blk_info.time() - p_time) };
 			real abs_time{ std::abs(real_timestamp - pred_timestamp) };
 
+			const size_t grammar_size = prophet.getGrammarSize();
 			if (config.verbose)
 			{
 				std::ostringstream oss;
-				oss << "Grammar size = " << prophet.getGrammarSize() << '\n'
+				oss << "Grammar size = " << grammar_size << '\n'
 					<< "Latency = " << std::fixed << std::setprecision(6) << clock.time() << '\n'
 					<< "Pred(%) = " << std::setprecision(2) << pred_percent << '\n'
 					<< "Total Pred(%) = " << std::setprecision(9) << _total_prediction_ << '\n'
@@ -321,7 +407,7 @@ namespace pIOn
 				pred_file << config.pid << " " << blk_info.lba() << " " << blk_info.size() << '\n';
 			}
 
-			ofile << prophet.getGrammarSize() << " " 
+			ofile << grammar_size << " " 
 				<< clock.time() << " " 
 				<< pred_percent << " " 
 				<< _total_prediction_ << " "
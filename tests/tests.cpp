@@ -4,9 +4,29 @@
 #include <cstdlib>
 
 #include "predictor.hpp"
+#include "compact_predictor.hpp"
 #include "blktrace_parser.hpp"
 #include "jd_test.hpp"
 #include "key_functions/standart_key.hpp"
+#include "key_functions/delta_key.hpp"
+#include "key_functions/interned_key.hpp"
+#include "key_functions/simple_key.hpp"
+#include "utils/digram_table.hpp"
+#include "utils/small_set.hpp"
+#include "utils/flat_map.hpp"
+#include "utils/pair_map_adapter.hpp"
+#include "utils/published.hpp"
+#include "utils/object_pool.hpp"
+#include "stats/quantile_sketch.hpp"
+#include "model/io_prophet.hpp"
+#include "model/sharded_prophet.hpp"
+#include "model/memory_budget.hpp"
+#include "engines/context_predictor.hpp"
+#include <atomic>
+#include <thread>
+#include <map>
+#include <random>
+#include <array>
 
 using namespace pIOn;
 
@@ -178,16 +198,1560 @@ namespace test
 			<< ", diff = " << (size - uniques_cnt.size()) << std::endl;
 	}
 
+	void digram_table_test()
+	{
+		// Small alphabet gives long probe chains and a lot of backward shifts
+		utils::DigramTable<int*> table;
+		std::map<std::pair<uint64_t, uint64_t>, int*> reference;
+		std::vector<int> values(64);
+		std::mt19937_64 gen{ 1 };
+
+		for (size_t i = 0; i < 100000; ++i) {
+			const uint64_t a = gen() % 40, b = gen() % 40;
+			int* value = &values[gen() % values.size()];
+
+			if (gen() % 3 == 0) {
+				auto it = reference.find({ a, b });
+				const bool expected = it != reference.end() && it->second == value;
+				if (expected) {
+					reference.erase(it);
+				}
+				ASSERT_EQUAL(table.erase(a, b, value), expected);
+			}
+			else {
+				reference[{ a, b }] = value;
+				table.assign(a, b, value);
+			}
+
+			ASSERT_EQUAL(table.size(), reference.size());
+		}
+
+		for (uint64_t a = 0; a < 40; ++a) {
+			for (uint64_t b = 0; b < 40; ++b) {
+				auto it = reference.find({ a, b });
+				ASSERT(table.find(a, b) == (it == reference.end() ? nullptr : it->second));
+			}
+		}
+
+		table.clear();
+		ASSERT_EQUAL(table.size(), 0);
+		ASSERT(table.find(0, 0) == nullptr);
+	}
+
+	void small_set_test()
+	{
+		utils::SmallFlatSet<uint64_t, 3> set;
+		std::set<uint64_t> reference;
+		std::mt19937_64 gen{ 2 };
+
+		for (size_t i = 0; i < 20000; ++i) {
+			// let the set grow past the inline capacity from time to time
+			const uint64_t value = gen() % (i % 1000 < 500 ? 4 : 16);
+			if (gen() % 2) {
+				ASSERT_EQUAL(set.insert(value).second, reference.insert(value).second);
+			}
+			else {
+				ASSERT_EQUAL(set.erase(value), reference.erase(value));
+			}
+
+			ASSERT_EQUAL(set.size(), reference.size());
+			ASSERT(std::equal(set.begin(), set.end(), reference.begin(), reference.end()));
+		}
+
+		auto copy = set;
+		copy.insert(reference.begin(), reference.end());
+		ASSERT(std::equal(copy.begin(), copy.end(), reference.begin(), reference.end()));
+
+		auto moved = std::move(copy);
+		ASSERT(copy.empty());
+		ASSERT(std::equal(moved.begin(), moved.end(), reference.begin(), reference.end()));
+	}
+
+	void flat_map_test()
+	{
+		utils::FlatMap<uint64_t, uint64_t> map;
+		std::map<uint64_t, uint64_t> reference;
+		std::mt19937_64 gen{ 4 };
+
+		for (size_t i = 0; i < 100000; ++i) {
+			const uint64_t key = gen() % 300;
+			if (gen() % 3 == 0) {
+				ASSERT_EQUAL(map.erase(key), reference.erase(key) == 1);
+			}
+			else {
+				map[key] += i;
+				reference[key] += i;
+			}
+
+			ASSERT_EQUAL(map.size(), reference.size());
+		}
+
+		for (uint64_t key = 0; key < 300; ++key) {
+			auto it = reference.find(key);
+			const uint64_t* value = map.find(key);
+			ASSERT_EQUAL(value != nullptr, it != reference.end());
+			if (value) {
+				ASSERT_EQUAL(*value, it->second);
+			}
+		}
+
+		size_t visited{};
+		map.for_each([&](uint64_t key, uint64_t value) {
+			ASSERT_EQUAL(reference.at(key), value);
+			++visited;
+		});
+		ASSERT_EQUAL(visited, reference.size());
+
+		map.clear();
+		ASSERT(map.empty() && map.find(0) == nullptr);
+	}
+
+	void compact_grammar_test()
+	{
+		sequitur::Predictor linked;
+		sequitur::CompactPredictor compact;
+		linked.setLimits(400);
+		compact.setLimits(400);
+		std::mt19937_64 gen{ 3 };
+
+		for (size_t i = 0; i < 3000; ++i) {
+			const uint64_t sym = 1 + (gen() % 4 == 0 ? gen() % 30 : i % 9);
+			ASSERT_EQUAL(linked.insert(sym), compact.insert(sym));
+			ASSERT_EQUAL(linked.size(), compact.size());
+			ASSERT_EQUAL(linked.stats().rules, compact.stats().rules);
+			ASSERT_EQUAL(linked.stats().digrams, compact.stats().digrams);
+		}
+
+		std::ostringstream linked_grammar, compact_grammar;
+		linked_grammar << linked;
+		compact_grammar << compact;
+		ASSERT_EQUAL(linked_grammar.str(), compact_grammar.str());
+
+		for (auto iter : compact.predict_range()) {
+			ASSERT(iter->term());
+		}
+	}
+
+	void grammar_eviction_test()
+	{
+		sequitur::Predictor linked;
+		sequitur::CompactPredictor compact;
+		linked.setLimits(300);
+		compact.setLimits(300);
+		linked.setLimitPolicy(sequitur::limit_policy_t::EVICT);
+		compact.setLimitPolicy(sequitur::limit_policy_t::EVICT);
+		std::mt19937_64 gen{ 5 };
+
+		size_t hits{};
+		std::list<uint64_t> predicted;
+		for (size_t i = 0; i < 5000; ++i) {
+			const uint64_t sym = 1 + (gen() % 5 == 0 ? gen() % 40 : i % 13);
+			hits += std::find(predicted.begin(), predicted.end(), sym) != predicted.end();
+
+			// the grammar is never thrown away, it stays under the limit instead
+			ASSERT(linked.insert(sym) && compact.insert(sym));
+			ASSERT(linked.size() <= 300);
+			ASSERT_EQUAL(linked.size(), compact.size());
+			ASSERT_EQUAL(linked.stats().rules, compact.stats().rules);
+			predicted = compact.predict_next();
+		}
+
+		std::ostringstream linked_grammar, compact_grammar;
+		linked_grammar << linked;
+		compact_grammar << compact;
+		ASSERT_EQUAL(linked_grammar.str(), compact_grammar.str());
+
+		// the repeating part keeps being predicted across the limit
+		ASSERT(hits > 2500);
+	}
+
+	void insert_batch_test()
+	{
+		sequitur::CompactPredictor single, batched, trained;
+		single.setLimits(700);
+		batched.setLimits(700);
+		trained.setLimits(700);
+		std::mt19937_64 gen{ 7 };
+
+		std::vector<uint64_t> batch;
+		for (size_t i = 0; i < 4000; i += batch.size()) {
+			batch.resize(1 + gen() % 64);
+			for (size_t j = 0; j < batch.size(); ++j) {
+				batch[j] = 1 + (gen() % 6 == 0 ? gen() % 30 : (i + j) % 17);
+			}
+
+			bool within_limits = true;
+			for (uint64_t sym : batch) {
+				within_limits &= single.insert(sym);
+			}
+			ASSERT_EQUAL(batched.insert_batch(batch), within_limits);
+			ASSERT_EQUAL(trained.insert_batch(batch, true), within_limits);
+
+			// the same grammar and, unless only the last symbol is predicted, the same predictions
+			ASSERT_EQUAL(batched.size(), single.size());
+			ASSERT_EQUAL(trained.size(), single.size());
+			ASSERT(batched.predict_next() == single.predict_next());
+		}
+
+		std::ostringstream single_grammar, trained_grammar;
+		single_grammar << single;
+		trained_grammar << trained;
+		ASSERT_EQUAL(single_grammar.str(), trained_grammar.str());
+		ASSERT(!trained.predict_next().empty());
+
+		// a limit no eviction can meet is checked on every symbol of the batch, as by insert()
+		auto unreachable = [](auto single, auto batched) {
+			single.setLimitPolicy(sequitur::limit_policy_t::EVICT);
+			batched.setLimitPolicy(sequitur::limit_policy_t::EVICT);
+			single.setLimits(1);
+			batched.setLimits(1);
+
+			const std::vector<uint64_t> repeating{ 1, 2, 3, 1, 2, 3, 1, 2, 3, 4, 5, 6, 4, 5, 6, 1, 2, 3 };
+			for (size_t i = 0; i < 4; ++i) {
+				for (uint64_t sym : repeating) {
+					single.insert(sym);
+				}
+				batched.insert_batch(repeating);
+				ASSERT_EQUAL(batched.size(), single.size());
+				ASSERT(batched.size() <= 2);
+			}
+		};
+		unreachable(sequitur::Predictor{}, sequitur::Predictor{});
+		unreachable(sequitur::CompactPredictor{}, sequitur::CompactPredictor{});
+	}
+
+	void snapshot_test()
+	{
+		const std::string path = "pIOn_snapshot_test.bin";
+		model::prophet_cfg_t linked_cfg;
+		model::prophet_cfg_t compact_cfg;
+		linked_cfg.grammar_limits_ = compact_cfg.grammar_limits_ = 100000;
+		compact_cfg.storage_ = model::grammar_storage_t::COMPACT;
+
+		model::IOProphet linked{ linked_cfg };
+		model::IOProphet trained{ compact_cfg };
+		std::mt19937_64 gen{ 6 };
+		auto next_info = [&gen, time = 0.0](size_t i) mutable {
+			time += 0.5 + static_cast<double>(gen() % 100) / 100.0;
+			const uint64_t lba = 8 * (gen() % 4 == 0 ? gen() % 50 : i % 11);
+			return BlkInfoBuilder{}.setSector(lba).setSize(4096).setTime(time).setOp(0).build();
+		};
+
+		for (size_t i = 0; i < 2000; ++i) {
+			const auto info = next_info(i);
+			linked.insert(info);
+			trained.insert(info);
+		}
+
+		// the snapshot of the linked grammar can be loaded into the compact one
+		model::IOProphet loaded{ compact_cfg };
+		linked.save(path);
+		loaded.load(path);
+		ASSERT_EQUAL(loaded.getGrammarSize(), linked.getGrammarSize());
+		ASSERT_EQUAL(loaded.getGrammarStats().rules, linked.getGrammarStats().rules);
+		ASSERT_EQUAL(loaded.getGrammarStats().digrams, linked.getGrammarStats().digrams);
+		ASSERT_EQUAL(loaded.getGrammarStats().predictions, linked.getGrammarStats().predictions);
+
+		// the loaded prophet goes on exactly as the saved one
+		trained.save(path);
+		loaded.load(path);
+		for (size_t i = 2000; i < 3000; ++i) {
+			const auto info = next_info(i);
+			trained.insert(info);
+			loaded.insert(info);
+			ASSERT(trained.predict() == loaded.predict());
+		}
+
+		// a broken file is rejected
+		{
+			std::ofstream file{ path, std::ios_base::binary | std::ios_base::trunc };
+			file << "pIOnSNAP, but not really";
+		}
+		bool thrown = false;
+		try {
+			loaded.load(path);
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+		std::remove(path.c_str());
+	}
+
+	void sharded_prophet_test()
+	{
+		model::sharded_cfg_t config;
+		config.prophet_.grammar_limits_ = 300;
+		config.prophet_.storage_ = model::grammar_storage_t::COMPACT;
+		config.key_ = model::shard_key_t::PID;
+		config.workers_ = 3;
+		config.batch_size_ = 7;
+
+		model::ShardedProphet sharded{ config };
+		std::map<uint64_t, model::IOProphet> serial;
+		std::atomic<size_t> observed{ 0 };
+		sharded.setObserver([&observed](uint64_t, const model::IOProphet&, const blk_info_t&) {
+			observed.fetch_add(1, std::memory_order_relaxed);
+		});
+
+		std::mt19937_64 gen{ 9 };
+		BlkInfoBuilder builder;
+		const size_t count = 5000;
+		for (size_t i = 0; i < count; ++i) {
+			const uint32_t pid = static_cast<uint32_t>(1 + gen() % 5);
+			const blk_info_t info = builder.setPid(pid)
+				.setCpu(static_cast<uint32_t>(gen() % 4))
+				.setSector(pid * 1000 + (gen() % 4 == 0 ? gen() % 50 : i % (3 + pid)) * 8)
+				.setSize(4096)
+				.setTime(static_cast<double>(i))
+				.setOp(pid % 2)
+				.build();
+
+			ASSERT_EQUAL(sharded.shardOf(info), pid);
+			sharded.insert(info);
+			serial.try_emplace(pid, config.prophet_).first->second.insert(info);
+		}
+		sharded.flush();
+
+		// every shard sees its requests in order, so it learns what a serial prophet learns
+		ASSERT_EQUAL(observed.load(), count);
+		ASSERT_EQUAL(sharded.getShards().size(), serial.size());
+		size_t visited = 0;
+		sharded.for_each([&serial, &visited](uint64_t shard, const model::IOProphet& prophet) {
+			ASSERT_EQUAL(prophet.getGrammarSize(), serial.at(shard).getGrammarSize());
+			++visited;
+		});
+		ASSERT_EQUAL(visited, serial.size());
+		for (const auto& [shard, prophet] : serial) {
+			ASSERT(sharded.predict(shard) == prophet.predict());
+		}
+		ASSERT(sharded.predict(42).empty());
+	}
+
+	void published_predictions_test()
+	{
+		// a reader sees either an old or a new value, never one that is being written
+		{
+			utils::Published<std::vector<uint64_t>, 4> cell;
+			std::atomic<bool> done{ false };
+			std::atomic<size_t> torn{ 0 };
+			std::vector<std::thread> readers;
+			for (size_t i = 0; i < 3; ++i) {
+				readers.emplace_back([&cell, &done, &torn] {
+					uint64_t last_version = 0;
+					while (!done.load(std::memory_order_acquire)) {
+						auto value = cell.read();
+						const bool is_whole = std::all_of(value->cbegin(), value->cend(), [n = value->size()](uint64_t x) {
+							return x == n;
+						});
+						if (!is_whole || value.version() < last_version) {
+							torn.fetch_add(1, std::memory_order_relaxed);
+						}
+						last_version = value.version();
+					}
+				});
+			}
+
+			size_t published = 0;
+			for (uint64_t n = 1; n <= 20000; ++n) {
+				published += cell.publish([n](std::vector<uint64_t>& value) {
+					value.assign(n % 97, n % 97);
+				});
+			}
+			done.store(true, std::memory_order_release);
+			for (auto& reader : readers) {
+				reader.join();
+			}
+
+			ASSERT_EQUAL(torn.load(), 0ULL);
+			ASSERT(published > 0);
+			ASSERT_EQUAL(cell.version(), published);
+		}
+
+		// the learner publishes after every insert, a reader follows it without locks
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 2000;
+		config.storage_ = model::grammar_storage_t::COMPACT;
+		config.publish_predictions_ = true;
+		model::IOProphet prophet{ config };
+		ASSERT(prophet.getPublishedPredictions()->empty());
+
+		std::atomic<bool> done{ false };
+		std::atomic<size_t> reads{ 0 };
+		std::thread reader{ [&prophet, &done, &reads] {
+			while (!done.load(std::memory_order_acquire)) {
+				auto pack = prophet.getPublishedPredictions();
+				reads.fetch_add(pack->size(), std::memory_order_relaxed);
+			}
+		} };
+
+		std::mt19937_64 gen{ 10 };
+		BlkInfoBuilder builder;
+		for (size_t i = 0; i < 5000; ++i) {
+			prophet.insert(builder.setSector((gen() % 5 == 0 ? gen() % 40 : i % 13) * 8)
+				.setSize(4096)
+				.setTime(static_cast<double>(i))
+				.setOp(0)
+				.build());
+		}
+		done.store(true, std::memory_order_release);
+		reader.join();
+
+		ASSERT(*prophet.getPublishedPredictions() == prophet.predict());
+		ASSERT(!prophet.predict().empty());
+	}
+
+	template<typename PredictorT>
+	void cursor_test_for()
+	{
+		PredictorT predictor;
+		const uint64_t period[] = { 3, 1, 4, 1, 5, 9, 2, 6, 5 };
+		const size_t length = std::size(period);
+		std::mt19937_64 gen{ 11 };
+
+		size_t followed = 0;
+		for (size_t i = 0; i < 3000; ++i) {
+			predictor.insert(gen() % 10 == 0 ? 100 + gen() % 5 : period[i % length]);
+
+			const auto next = predictor.predict_next();
+			bool is_followed = false;
+			size_t cursors = 0;
+			predictor.for_each_cursor([&](auto cursor) {
+				++cursors;
+				ASSERT(std::find(next.cbegin(), next.cend(), *cursor) != next.cend());
+
+				// read() and advance() walk the same continuation
+				auto copy = cursor;
+				uint64_t ahead[16]{};
+				const size_t count = cursor.read(ahead);
+				for (size_t k = 0; k < count; ++k, ++copy) {
+					ASSERT_EQUAL(*copy, ahead[k]);
+				}
+				ASSERT(copy.done() == cursor.done());
+
+				bool matches = count == std::size(ahead);
+				for (size_t k = 0; k < count; ++k) {
+					matches &= ahead[k] == period[(i + 1 + k) % length];
+				}
+				is_followed |= matches;
+			});
+			followed += is_followed;
+			ASSERT_EQUAL(cursors, predictor.predict_all().size());
+		}
+		// a period that has been learned is predicted 16 steps ahead
+		ASSERT(followed > 1000);
+
+		// 1 2 | 1 2 3 | 1 2 3 4 | ... nests every prefix in the next one, deeper than a cursor holds
+		PredictorT deep;
+		for (uint64_t k = 2; k <= 60; ++k) {
+			for (uint64_t x = 1; x <= k; ++x) {
+				deep.insert(x);
+			}
+		}
+		deep.insert(1);
+
+		size_t truncated = 0;
+		deep.for_each_cursor([&truncated](auto cursor) {
+			if (!cursor.truncated()) {
+				return;
+			}
+
+			// the inner rules are read in full, the outermost ones are lost
+			++truncated;
+			size_t count = 0;
+			for (uint64_t x = 2; !cursor.done(); ++x, ++cursor, ++count) {
+				ASSERT_EQUAL(*cursor, x);
+			}
+			ASSERT_EQUAL(count, PredictorT::cursor::MAX_DEPTH);
+		});
+		ASSERT(truncated > 0);
+
+		// the cursors are invalidated by an insert
+		bool thrown = false;
+		typename PredictorT::cursor stale;
+		predictor.for_each_cursor([&stale](auto cursor) { stale = cursor; });
+		predictor.insert(1);
+		try {
+			++stale;
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+	}
+
+	void cursor_test()
+	{
+		cursor_test_for<sequitur::Predictor>();
+		cursor_test_for<sequitur::CompactPredictor>();
+
+		model::prophet_cfg_t config;
+		config.storage_ = model::grammar_storage_t::COMPACT;
+		model::IOProphet prophet{ config };
+		BlkInfoBuilder builder;
+		for (size_t i = 0; i < 2000; ++i) {
+			prophet.insert(builder.setSector((i % 6) * 64).setSize(4096).setTime(1.0).setOp(0).build());
+		}
+
+		// a continuation ends with the axiom, here it is the last period; the requests are a second apart
+		model::IOProphet::predict_pack_t ahead;
+		prophet.predictAhead(8, ahead);
+		ASSERT_EQUAL(ahead.size(), 6ULL);
+		for (size_t k = 0; k < ahead.size(); ++k) {
+			ASSERT_EQUAL(ahead[k].info_.lba(), ((2000 + k) % 6) * 64);
+			ASSERT(std::abs(ahead[k].info_.time() - static_cast<double>(k + 1)) < 1e-9);
+		}
+	}
+
+	void predict_top_test()
+	{
+		model::prophet_cfg_t config;
+		config.storage_ = model::grammar_storage_t::COMPACT;
+		model::IOProphet prophet{ config };
+		BlkInfoBuilder builder;
+		std::mt19937_64 gen{ 12 };
+		const uint64_t period[] = { 5, 2, 7, 2, 9, 1, 3 };
+
+		std::array<model::scored_prediction_t, 3> top{};
+		size_t hits = 0, issued = 0;
+		for (size_t i = 0; i < 6000; ++i) {
+			const uint64_t sector = (gen() % 8 == 0 ? 20 + gen() % 20 : period[i % std::size(period)]) * 64;
+			if (i > 3000) {
+				const size_t count = prophet.predict_top(top);
+				ASSERT(count <= top.size());
+				for (size_t j = 0; j < count; ++j) {
+					ASSERT(top[j].confidence_ > 0.0 && top[j].confidence_ <= 1.0);
+					if (j > 0) {
+						ASSERT(top[j - 1].confidence_ >= top[j].confidence_);
+					}
+					for (size_t m = 0; m < j; ++m) {
+						ASSERT(top[m].info_.lba() != top[j].info_.lba());
+					}
+				}
+				if (count) {
+					++issued;
+					hits += top[0].info_.lba() == sector;
+				}
+			}
+			prophet.insert(builder.setSector(sector).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+
+		// the best candidate of a mostly periodic stream is usually the right one
+		ASSERT(issued > 2500);
+		ASSERT(hits * 10 > issued * 7);
+		ASSERT_EQUAL(prophet.predict_top(std::span<model::scored_prediction_t>{}), 0ULL);
+	}
+
+	void object_pool_test()
+	{
+		struct item_t
+		{
+			uint64_t value;
+			std::vector<int> payload;
+		};
+
+		utils::ObjectPool<item_t> pool;
+		std::vector<item_t*> items;
+		for (uint64_t i = 0; i < 1000; ++i) {
+			items.push_back(pool.allocate(item_t{ i, { 1, 2, 3 } }));
+		}
+		ASSERT_EQUAL(pool.size(), 1000ULL);
+		// 64 + 128 + 256 + 512 + 1024 slots
+		ASSERT_EQUAL(pool.chunks(), 5ULL);
+		ASSERT_EQUAL(pool.capacity(), 1984ULL);
+
+		// a freed slot is reused first
+		item_t* freed = items[500];
+		pool.deallocate(freed);
+		ASSERT_EQUAL(pool.allocate(item_t{ 7, {} }), freed);
+		for (uint64_t i = 0; i < items.size(); ++i) {
+			ASSERT_EQUAL(items[i]->value, i == 500 ? 7ULL : i);
+		}
+
+		// after a reset the same chunks serve the same amount of objects
+		for (item_t* item : items) {
+			std::destroy_at(item);
+		}
+		pool.reset();
+		ASSERT_EQUAL(pool.size(), 0ULL);
+		for (uint64_t i = 0; i < 1000; ++i) {
+			items[i] = pool.allocate(item_t{ i, {} });
+		}
+		ASSERT_EQUAL(pool.chunks(), 5ULL);
+
+		// the grammar is built in the same memory after a reset
+		sequitur::Predictor predictor;
+		predictor.setLimits(400);
+		std::mt19937_64 gen{ 13 };
+		size_t resets = 0;
+		for (size_t i = 0; i < 20000; ++i) {
+			resets += !predictor.insert(1 + gen() % 12);
+		}
+		ASSERT(resets > 10);
+	}
+
+	void memory_usage_test()
+	{
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 100000;
+		model::IOProphet linked{ config };
+		config.storage_ = model::grammar_storage_t::COMPACT;
+		model::IOProphet compact{ config };
+
+		// the rule of 1 2 gets far more users than fit inline
+		BlkInfoBuilder builder;
+		for (uint64_t i = 0; i < 500; ++i) {
+			for (uint64_t lba : { uint64_t{ 8 }, uint64_t{ 16 }, 1000 + i * 8 }) {
+				const blk_info_t info = builder.setSector(lba).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build();
+				linked.insert(info);
+				compact.insert(info);
+			}
+		}
+
+		for (const model::IOProphet* prophet : { &linked, &compact }) {
+			const auto stats = prophet->getGrammarStats();
+			const auto usage = prophet->memory_usage();
+			ASSERT(usage.symbols >= stats.symbols * 24);
+			ASSERT(usage.digram_index >= stats.digrams * 2 * sizeof(uint64_t));
+			ASSERT(usage.users_sets >= 500 * sizeof(uint32_t)); // handles of the compact storage are 32-bit
+			ASSERT(usage.occurrences > 0);
+			ASSERT(usage.time_table > 0);
+			ASSERT(usage.total() > usage.symbols + usage.digram_index + usage.time_table);
+		}
+		ASSERT_EQUAL(linked.memory_usage().time_table, compact.memory_usage().time_table);
+		ASSERT(linked.memory_usage().symbols >= linked.getGrammarStats().symbols * sizeof(sequitur::Symbols));
+
+		// an unbounded limit does not presize the index for it
+		for (auto storage : { model::grammar_storage_t::LINKED, model::grammar_storage_t::COMPACT }) {
+			config.grammar_limits_ = ~size_t{};
+			config.storage_ = storage;
+			ASSERT(model::IOProphet{ config }.memory_usage().digram_index < (1ULL << 20));
+		}
+	}
+
+	void memory_limit_test()
+	{
+		constexpr size_t LIMIT = 256 * 1024;
+		BlkInfoBuilder builder;
+		std::vector<blk_info_t> infos;
+		std::mt19937_64 gen{ 17 };
+		for (size_t i = 0; i < 20000; ++i) {
+			const uint64_t lba = gen() % 4 == 0 ? gen() % 5000 : i % 97;
+			infos.push_back(builder.setSector(lba * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 100000;
+		model::IOProphet unlimited{ config };
+		for (const blk_info_t& info : infos) {
+			unlimited.insert(info);
+		}
+		ASSERT(unlimited.footprint() > 2 * LIMIT);
+
+		for (auto storage : { model::grammar_storage_t::LINKED, model::grammar_storage_t::COMPACT }) {
+			for (auto policy : { sequitur::limit_policy_t::RESET, sequitur::limit_policy_t::EVICT }) {
+				config.storage_ = storage;
+				config.limit_policy_ = policy;
+				config.memory_limit_ = LIMIT;
+				model::IOProphet prophet{ config };
+
+				size_t max_footprint = 0;
+				for (const blk_info_t& info : infos) {
+					prophet.insert(info);
+					max_footprint = std::max(max_footprint, prophet.footprint());
+				}
+				ASSERT(max_footprint <= LIMIT);
+				ASSERT(max_footprint > LIMIT / 2);
+				ASSERT(prophet.getGrammarSize() > 1);
+
+				// the batch is checked once, at its end
+				prophet.insert_batch(infos);
+				ASSERT(prophet.footprint() <= LIMIT);
+
+				// lowering the limit trims at once
+				prophet.setMemoryLimit(LIMIT / 4);
+				ASSERT(prophet.footprint() <= LIMIT / 4);
+			}
+		}
+
+		// the region levels and the size model are trimmed along with the exact grammar
+		config.storage_ = model::grammar_storage_t::COMPACT;
+		config.region_levels_ = { 4ULL << 10, 1ULL << 20, 64ULL << 20 };
+		config.factorized_ = true;
+		for (auto policy : { sequitur::limit_policy_t::RESET, sequitur::limit_policy_t::EVICT }) {
+			config.limit_policy_ = policy;
+			config.memory_limit_ = 0;
+			model::IOProphet models{ config };
+			config.memory_limit_ = LIMIT;
+			model::IOProphet prophet{ config };
+
+			size_t max_footprint = 0;
+			for (const blk_info_t& info : infos) {
+				models.insert(info);
+				prophet.insert(info);
+				max_footprint = std::max(max_footprint, prophet.footprint());
+			}
+			ASSERT(models.memory_usage().regions > LIMIT);
+			ASSERT(max_footprint <= LIMIT);
+			// the exact grammar keeps its share instead of being trimmed on every insert
+			ASSERT(prophet.getGrammarSize() > 100);
+			ASSERT(prophet.getPredictionStats().hits_ > models.getPredictionStats().hits_ / 4);
+		}
+
+		// the interned keys outlive the evicted symbols, the table is forgotten once it takes its share
+		config.region_levels_.clear();
+		config.factorized_ = false;
+		config.key_ = model::key_function_t::INTERNED;
+		config.limit_policy_ = sequitur::limit_policy_t::EVICT;
+		model::IOProphet interning{ config };
+		size_t max_footprint = 0;
+		for (const blk_info_t& info : infos) {
+			interning.insert(info);
+			max_footprint = std::max(max_footprint, interning.footprint());
+		}
+		ASSERT(max_footprint <= LIMIT);
+		ASSERT(interning.getGrammarSize() > 100);
+
+		// without a memory limit an evicting prophet stays bounded by its grammar limit too
+		model::prophet_cfg_t evicting_config;
+		evicting_config.limit_policy_ = sequitur::limit_policy_t::EVICT;
+		model::IOProphet evicting{ evicting_config };
+		size_t early = 0;
+		for (size_t i = 0; i < 160000; ++i) {
+			const uint64_t lba = gen() % 3 == 0 ? gen() % (1ULL << 30) : i % 211;
+			evicting.insert(builder.setSector(lba * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+			early = i == 40000 ? evicting.footprint() : early;
+		}
+		ASSERT(evicting.footprint() < early * 11 / 10);
+
+		// the containers hold at least what the live objects need
+		ASSERT(unlimited.footprint() <= unlimited.memory_usage().total());
+	}
+
+	void memory_budget_test()
+	{
+		model::budget_cfg_t budget_config;
+		budget_config.total_bytes_ = 1 << 20;
+		budget_config.min_bytes_ = 64 << 10;
+		model::MemoryBudget budget{ budget_config };
+
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 100000;
+		model::IOProphet looping{ config }, noisy{ config }, idle{ config };
+		for (model::IOProphet* prophet : { &looping, &noisy, &idle }) {
+			budget.attach(*prophet);
+			ASSERT_EQUAL(prophet->getMemoryLimit(), budget_config.min_bytes_);
+		}
+		ASSERT_EQUAL(budget.size(), 3ULL);
+
+		BlkInfoBuilder builder;
+		std::mt19937_64 gen{ 19 };
+		for (size_t i = 0; i < 20000; ++i) {
+			looping.insert(builder.setSector(i % 50 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+			noisy.insert(builder.setSector(gen() % 100000 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+		ASSERT(looping.getPredictionStats().hits_ > noisy.getPredictionStats().hits_);
+		ASSERT_EQUAL(looping.getPredictionStats().requests_, 20000ULL);
+
+		budget.rebalance();
+		ASSERT(looping.getMemoryLimit() > noisy.getMemoryLimit());
+		ASSERT_EQUAL(idle.getMemoryLimit(), budget_config.min_bytes_);
+		ASSERT(looping.getMemoryLimit() + noisy.getMemoryLimit() + idle.getMemoryLimit() <= budget_config.total_bytes_);
+		ASSERT(budget.footprint() <= budget_config.total_bytes_);
+
+		// a quiet period moves the memory away from the prophet that made the hits
+		for (size_t i = 0; i < 40000; ++i) {
+			noisy.insert(builder.setSector(i % 30 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+		budget.rebalance();
+		ASSERT(looping.getMemoryLimit() < noisy.getMemoryLimit());
+
+		budget.detach(idle);
+		ASSERT_EQUAL(budget.size(), 2ULL);
+
+		// the shards of a sharded prophet share one budget
+		model::sharded_cfg_t sharded_config;
+		sharded_config.workers_ = 2;
+		sharded_config.memory_budget_ = 4 << 20; // the floor of 256 KB leaves 3 MB to share
+		model::ShardedProphet sharded{ sharded_config };
+		for (size_t i = 0; i < 20000; ++i) {
+			const uint32_t pid = static_cast<uint32_t>(i % 4);
+			const uint64_t lba = pid == 0 ? i % 40 : gen() % 100000;
+			sharded.insert(builder.setPid(pid).setSector(lba * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+		sharded.rebalance();
+
+		size_t footprint = 0, best = 0;
+		uint64_t best_shard = ~0ULL;
+		sharded.for_each([&](uint64_t shard, const model::IOProphet& prophet) {
+			footprint += prophet.footprint();
+			if (prophet.getMemoryLimit() > best) {
+				best = prophet.getMemoryLimit();
+				best_shard = shard;
+			}
+		});
+		ASSERT(footprint <= sharded_config.memory_budget_);
+		ASSERT_EQUAL(best_shard, 0ULL);
+	}
+
+	void context_engine_test()
+	{
+		// a loop of ten keys, the successor of every key is known after one pass
+		engines::ContextPredictor markov{ 1, engines::context_mode_t::MARKOV };
+		for (uint64_t i = 0; i < 100; ++i) {
+			ASSERT(markov.insert(1 + i % 10));
+		}
+		ASSERT_EQUAL(markov.size(), 10ULL);
+		ASSERT_EQUAL(markov.predict_range().size(), 1ULL);
+		ASSERT_EQUAL((*markov.predict_range().begin())->get_symbol(), 1ULL);
+
+		std::array<uint64_t, 5> continuation{};
+		markov.for_each_cursor([&continuation](auto cursor) {
+			ASSERT_EQUAL(cursor.read(continuation), continuation.size());
+		});
+		ASSERT(continuation == (std::array<uint64_t, 5>{ 1, 2, 3, 4, 5 }));
+
+		bool thrown = false;
+		markov.for_each_cursor([&markov, &thrown](auto cursor) {
+			markov.insert(1);
+			try {
+				++cursor;
+			}
+			catch (const std::exception&) {
+				thrown = true;
+			}
+		});
+		ASSERT(thrown);
+
+		// 1 is followed by 2 or 4, the context of two keys tells which one
+		engines::ContextPredictor ppm{ 3, engines::context_mode_t::PPM };
+		for (size_t i = 0; i < 50; ++i) {
+			for (uint64_t key : { 1, 2, 3, 1, 4, 5 }) {
+				ppm.insert(key);
+			}
+		}
+		ppm.insert(3);
+		ppm.insert(1);
+		uint64_t total = 0;
+		std::vector<uint64_t> predicted;
+		for (auto prediction : ppm.predict_range()) {
+			predicted.push_back(prediction->get_symbol());
+			total += prediction->freq();
+		}
+		ASSERT(predicted.size() >= 2);
+		ASSERT_EQUAL(predicted.front(), 4ULL);
+		ASSERT(total <= engines::ContextPredictor::PPM_SCALE + predicted.size());
+
+		// at the limit the eviction ages the contexts, the reset drops them
+		std::mt19937_64 gen{ 23 };
+		engines::ContextPredictor evicting{ 2 };
+		evicting.setLimits(50);
+		evicting.setLimitPolicy(sequitur::limit_policy_t::EVICT);
+		engines::ContextPredictor resetting{ 2 };
+		resetting.setLimits(50);
+		size_t resets = 0;
+		for (size_t i = 0; i < 2000; ++i) {
+			const uint64_t key = 1 + gen() % 40;
+			ASSERT(evicting.insert(key));
+			resets += !resetting.insert(key);
+			ASSERT(evicting.size() <= 50);
+			ASSERT(resetting.size() <= 50);
+		}
+		ASSERT(resets > 0);
+
+		// the engines behind a prophet
+		BlkInfoBuilder builder;
+		for (auto engine : { engines::engine_t::MARKOV, engines::engine_t::PPM }) {
+			model::prophet_cfg_t config;
+			config.engine_ = engine;
+			config.context_order_ = 2;
+			model::IOProphet prophet{ config };
+			for (size_t i = 0; i < 400; ++i) {
+				prophet.insert(builder.setSector(i % 8 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+			}
+
+			const auto predictions = prophet.predict();
+			ASSERT_EQUAL(predictions.size(), 1ULL);
+			ASSERT_EQUAL(predictions.front().info_.lba(), 0ULL);
+
+			model::IOProphet::predict_pack_t ahead;
+			prophet.predictAhead(4, ahead);
+			ASSERT_EQUAL(ahead.size(), 4ULL);
+			ASSERT_EQUAL(ahead.back().info_.lba(), 24ULL);
+
+			std::array<model::scored_prediction_t, 2> top{};
+			ASSERT_EQUAL(prophet.predict_top(top), 1ULL);
+			ASSERT(top.front().confidence_ > 0.9);
+			ASSERT(prophet.getPredictionStats().hits_ > 350);
+			ASSERT(prophet.memory_usage().contexts > 0);
+
+			thrown = false;
+			try {
+				prophet.save("context_engine.snapshot");
+			}
+			catch (const std::runtime_error&) {
+				thrown = true;
+			}
+			ASSERT(thrown);
+		}
+		std::remove("context_engine.snapshot");
+	}
+
+	void stride_detector_test()
+	{
+		// a sequential stream of 4KB reads and a write stream with a stride of 64 sectors, a second apart
+		BlkInfoBuilder builder;
+		auto sequential = [&builder](uint64_t i, double gap = 1.0) {
+			return builder.setSector(1000 + i * 8).setSize(4096).setTime(gap).setOp(0).build();
+		};
+		auto strided = [&builder](uint64_t i) {
+			return builder.setSector(500000 + i * 64).setSize(4096).setTime(1.0).setOp(1).build();
+		};
+
+		model::StrideDetector detector{ 4 };
+		for (uint64_t i = 0; i < 3; ++i) {
+			ASSERT(!detector.observe(sequential(i)));
+			ASSERT(!detector.observe(strided(i)));
+		}
+		ASSERT_EQUAL(detector.size(), 2ULL);
+
+		// a random request in between neither is taken nor breaks the streams
+		ASSERT(!detector.observe(builder.setSector(1010).setSize(512).setTime(0.5).setOp(0).build()));
+		ASSERT(detector.observe(sequential(3, 0.5)));
+		ASSERT(detector.observe(strided(3)));
+
+		std::vector<blk_info_t> next;
+		detector.for_each_stream([&detector, &next](const auto& stream) {
+			next.push_back(detector.predict(stream, 2));
+		});
+		std::sort(next.begin(), next.end(), [](const blk_info_t& lhs, const blk_info_t& rhs) {
+			return lhs.lba() < rhs.lba();
+		});
+		ASSERT_EQUAL(next.size(), 2ULL);
+		ASSERT_EQUAL(next[0].lba(), 1040ULL);
+		ASSERT_EQUAL(next[0].type(), OPERATION::READ);
+		ASSERT_EQUAL(next[1].lba(), 500320ULL);
+		ASSERT_EQUAL(next[1].type(), OPERATION::WRITE);
+		ASSERT(std::abs(next[1].time() - 4.0) < 1e-9);
+
+		// a stream of requests 2 seconds apart is expected 2 seconds after its last one
+		model::StrideDetector steady{ 1 };
+		for (uint64_t i = 0; i < 10; ++i) {
+			steady.observe(sequential(i, 2.0));
+		}
+		steady.for_each_stream([&steady](const auto& stream) {
+			ASSERT(std::abs(steady.predict(stream).time() - 2.0) < 1e-9);
+			ASSERT(std::abs(steady.predict(stream, 3).time() - 6.0) < 1e-9);
+		});
+		ASSERT_EQUAL(steady.size(), 1ULL);
+
+		// the grammar learns only the loop of irregular requests between the runs
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 100000;
+		model::IOProphet plain{ config };
+		config.stride_streams_ = 4;
+		model::IOProphet prophet{ config };
+
+		const std::array<uint64_t, 4> irregular{ 77000, 12000, 93000, 31000 };
+		double time = 0.0;
+		uint64_t run = 0;
+		for (uint64_t i = 0; i < 2000; ++i) {
+			const blk_info_t info = i % 5 == 4
+				? builder.setSector(irregular[i / 5 % 4]).setSize(8192).setTime(time).setOp(0).build()
+				: builder.setSector(1000 + run++ * 8).setSize(4096).setTime(time).setOp(0).build();
+			plain.insert(info);
+			prophet.insert(info);
+			time += 1.0;
+		}
+
+		ASSERT(prophet.getGrammarSize() < 100);
+		ASSERT(plain.getGrammarSize() > 10 * prophet.getGrammarSize());
+		ASSERT(prophet.getPredictionStats().hits_ > 1900);
+		ASSERT(plain.getPredictionStats().hits_ < 1000);
+
+		const auto predictions = prophet.predict();
+		ASSERT(std::any_of(predictions.cbegin(), predictions.cend(), [](const auto& prediction) {
+			return prediction.info_.lba() == 1000 + 1600 * 8;
+		}));
+
+		model::IOProphet::predict_pack_t ahead;
+		prophet.predictAhead(3, ahead);
+		ASSERT(std::any_of(ahead.cbegin(), ahead.cend(), [](const auto& prediction) {
+			return prediction.info_.lba() == 1000 + 1602 * 8;
+		}));
+
+		std::array<model::scored_prediction_t, 4> top{};
+		ASSERT(prophet.predict_top(top) >= 1);
+		ASSERT_EQUAL(top.front().info_.lba(), 1000ULL + 1600 * 8);
+
+		// a batch goes through the streams the same way
+		config.stride_streams_ = 4;
+		model::IOProphet batched{ config };
+		std::vector<blk_info_t> batch;
+		for (uint64_t i = 0; i < 100; ++i) {
+			batch.push_back(sequential(i));
+		}
+		batched.insert_batch(batch);
+		ASSERT(batched.getGrammarSize() < 10);
+		ASSERT_EQUAL(batched.getPredictionStats().hits_, 100ULL - model::StrideDetector::MIN_RUN - 1);
+		ASSERT_EQUAL(batched.getPredictionStats().requests_, batched.getPredictionStats().hits_);
+
+		// a loop over a strided range is one stream, not a new one on every pass
+		model::IOProphet looping{ config };
+		for (uint64_t i = 0; i < 40; ++i) {
+			looping.insert(builder.setSector(i % 4 * 4096).setSize(4096).setTime(1.0).setOp(0).build());
+		}
+		const auto looped = looping.predict();
+		ASSERT(std::count_if(looped.cbegin(), looped.cend(), [](const auto& prediction) {
+			return prediction.info_.lba() == 16384;
+		}) <= 1);
+
+		std::array<model::scored_prediction_t, 4> distinct{};
+		const size_t count = looping.predict_top(distinct);
+		for (size_t i = 0; i < count; ++i) {
+			for (size_t j = i + 1; j < count; ++j) {
+				ASSERT(!(distinct[i].info_ == distinct[j].info_));
+			}
+		}
+	}
+
+	void delta_key_test()
+	{
+		BlkInfoBuilder builder;
+		keys::DeltaKey key;
+
+		const blk_info_t back = builder.setSector(99000).setSize(8192).setOp(1).build();
+		const uint64_t sym = key.to_key(back, 100000);
+		ASSERT(sym != 0);
+		ASSERT_EQUAL(key.from_key(sym, 100000).build(), back);
+
+		// the same step from another place is the same key
+		ASSERT_EQUAL(key.to_key(builder.setSector(6999000).build(), 7000000), sym);
+
+		const std::array<blk_info_t, 3> batch{
+			builder.setSector(7000008).setSize(4096).setOp(0).build(),
+			builder.setSector(7000016).build(),
+			builder.setSector(7000000).build()
+		};
+		std::array<uint64_t, 3> syms{};
+		key.to_keys(batch, syms.data(), 7000000);
+		ASSERT_EQUAL(syms[0], syms[1]);
+		uint64_t base = 7000000;
+		for (size_t i = 0; i < batch.size(); ++i) {
+			ASSERT_EQUAL(key.from_key(syms[i], base).build(), batch[i]);
+			base = batch[i].lba();
+		}
+
+		// a pattern of eight jumps replayed at a new region every time
+		const std::array<uint64_t, 8> pattern{ 0, 512, 64, 2048, 128, 1024, 8, 4096 };
+		auto run = [&builder, &pattern](model::key_function_t function) {
+			model::prophet_cfg_t config;
+			config.grammar_limits_ = 100000;
+			config.key_ = function;
+			model::IOProphet prophet{ config };
+			double time = 0.0;
+			for (uint64_t region = 0; region < 200; ++region) {
+				for (uint64_t offset : pattern) {
+					prophet.insert(builder.setSector(region * 100000 + offset).setSize(4096).setTime(time).setOp(0).build());
+					time += 1.0;
+				}
+			}
+			return prophet;
+		};
+
+		model::IOProphet absolute = run(model::key_function_t::STANDART);
+		model::IOProphet relative = run(model::key_function_t::DELTA);
+		ASSERT(relative.getGrammarSize() * 10 < absolute.getGrammarSize());
+		ASSERT(relative.getPredictionStats().hits_ > 1500);
+		ASSERT(absolute.getPredictionStats().hits_ < 100);
+
+		// the last request is the 4096th sector of region 199, the most frequent continuation goes to region 200
+		auto heaviest = [](const model::IOProphet::predict_pack_t& pack) {
+			return std::max_element(pack.cbegin(), pack.cend(), [](const auto& lhs, const auto& rhs) {
+				return lhs.weight_ < rhs.weight_;
+			});
+		};
+
+		const auto predictions = relative.predict();
+		ASSERT(!predictions.empty());
+		ASSERT_EQUAL(heaviest(predictions)->info_.lba(), 20000000ULL);
+
+		model::IOProphet::predict_pack_t ahead;
+		relative.predictAhead(3, ahead);
+		const auto first = heaviest(ahead);
+		ASSERT(ahead.cend() - first >= 3);
+		ASSERT_EQUAL(first[0].info_.lba(), 20000000ULL);
+		ASSERT_EQUAL(first[1].info_.lba(), 20000512ULL);
+		ASSERT_EQUAL(first[2].info_.lba(), 20000064ULL);
+	}
+
+	void interned_key_test()
+	{
+		// LBAs 2^34 sectors apart are one key of StandartKey
+		BlkInfoBuilder builder;
+		const blk_info_t low = builder.setSector(4096).setSize(1ULL << 35).setOp(1).build();
+		const blk_info_t high = builder.setSector(4096 + (1ULL << 34)).build();
+		keys::StandartKey standart;
+		ASSERT_EQUAL(standart.to_key(low), standart.to_key(high));
+
+		keys::InternedKey key;
+		ASSERT_EQUAL(key.to_key(low), 1ULL);
+		ASSERT_EQUAL(key.to_key(high), 2ULL);
+		ASSERT_EQUAL(key.to_key(low), 1ULL);
+		ASSERT_EQUAL(key.to_key(builder.setOp(0).build()), 3ULL);
+		ASSERT_EQUAL(key.size(), 3ULL);
+		ASSERT_EQUAL(key.from_key(2).build(), high);
+		ASSERT_EQUAL(key.from_key(1).build(), low);
+
+		key.clear();
+		ASSERT_EQUAL(key.size(), 0ULL);
+		ASSERT_EQUAL(key.to_key(high), 1ULL);
+
+		// the symbols that are not interned decode to nothing
+		ASSERT_EQUAL(key.from_key(0).build().type(), OPERATION::NONE);
+		ASSERT_EQUAL(key.from_key(2).build().type(), OPERATION::NONE);
+
+		// once the ids run out, the table starts anew
+		keys::InternedKey small{ 2 };
+		ASSERT_EQUAL(small.to_key(low), 1ULL);
+		ASSERT_EQUAL(small.to_key(high), 2ULL);
+		ASSERT_EQUAL(small.room(), 0ULL);
+		ASSERT_EQUAL(small.to_key(high), 2ULL);
+		ASSERT_EQUAL(small.to_key(builder.setSector(8).build()), 1ULL);
+		ASSERT_EQUAL(small.size(), 1ULL);
+		ASSERT_EQUAL(small.from_key(1).build().lba(), 8ULL);
+		ASSERT_EQUAL(small.from_key(2).build().type(), OPERATION::NONE);
+
+		// the keys are forgotten with the grammar, so a reset bounds the table
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 200;
+		config.key_ = model::key_function_t::INTERNED;
+		model::IOProphet prophet{ config };
+
+		std::mt19937_64 gen{ 20 };
+		double time = 0.0;
+		for (size_t i = 0; i < 2000; ++i) {
+			prophet.insert(builder.setSector(gen() % (1ULL << 50)).setSize(4096).setTime(time).setOp(0).build());
+			time += 1.0;
+		}
+		ASSERT(prophet.getGrammarSize() <= 200);
+		ASSERT(prophet.memory_usage().keys > 0);
+		ASSERT(prophet.memory_usage().keys < 200 * 160);
+
+		const std::array<uint64_t, 4> loop{ 1ULL << 45, 7, 1ULL << 41, 3ULL << 40 };
+		for (size_t i = 0; i < 40; ++i) {
+			prophet.insert(builder.setSector(loop[i % 4]).setSize(4096).setTime(time).setOp(0).build());
+			time += 1.0;
+		}
+
+		const auto predictions = prophet.predict();
+		ASSERT(std::any_of(predictions.cbegin(), predictions.cend(), [&loop](const auto& prediction) {
+			return prediction.info_.lba() == loop[0] && prediction.info_.size() == 4096;
+		}));
+
+		bool thrown = false;
+		try {
+			prophet.save("interned_key.snapshot");
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+		std::remove("interned_key.snapshot");
+	}
+
+	void region_levels_test()
+	{
+		// a cycle over four regions of 1 MiB, the offset in a region is new every time
+		const std::array<uint64_t, 4> regions{ 10, 50, 20, 80 };
+		constexpr uint64_t REGION_SECTORS = 2048;
+		BlkInfoBuilder builder;
+
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 2000;
+		model::IOProphet exact{ config };
+		config.region_levels_ = { 4ULL << 10, 1ULL << 20, 64ULL << 20 };
+		config.region_readahead_ = 256ULL << 10;
+		model::IOProphet prophet{ config };
+
+		double time = 0.0;
+		for (size_t i = 0; i < 1001; ++i) {
+			const uint64_t lba = regions[i % 4] * REGION_SECTORS + i / 4 * 7919 % (REGION_SECTORS / 8) * 8;
+			const blk_info_t info = builder.setSector(lba).setSize(4096).setTime(time).setOp(0).build();
+			exact.insert(info);
+			prophet.insert(info);
+			time += 1.0;
+		}
+
+		ASSERT(exact.predict().empty());
+		ASSERT_EQUAL(prophet.getPredictionStats().hits_, 0ULL);
+		ASSERT(prophet.getPredictionStats().region_hits_ > 950);
+		ASSERT_EQUAL(exact.getPredictionStats().region_hits_, 0ULL);
+
+		// the 4 KiB level has never been right, the 1 MiB one predicts the start of the region 50 after the region 10
+		const auto hints = prophet.predict();
+		ASSERT_EQUAL(hints.size(), 1ULL);
+		ASSERT_EQUAL(hints.front().info_.lba(), 50 * REGION_SECTORS);
+		ASSERT_EQUAL(hints.front().info_.size(), 256ULL << 10);
+		ASSERT_EQUAL(hints.front().info_.type(), OPERATION::READ);
+
+		// the levels share the grammar limit and their regions repeat, so they cost less than the exact grammar
+		const auto usage = prophet.memory_usage();
+		ASSERT(usage.regions > 0);
+		ASSERT(usage.regions < exact.memory_usage().total());
+
+		bool thrown = false;
+		try {
+			config.region_levels_ = { 1ULL << 20, 4096 };
+			model::IOProphet wrong{ config };
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+	}
+
+	void factorized_test()
+	{
+		// a loop of seven LBAs read with a loop of three sizes, the joint keys repeat after 21 requests
+		const std::array<uint64_t, 7> lbas{ 800, 16, 4000, 96, 2048, 560, 128 };
+		const std::array<uint64_t, 3> sizes{ 4096, 16384, 8192 };
+		BlkInfoBuilder builder;
+
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 100000;
+		model::IOProphet joint{ config };
+		config.factorized_ = true;
+		model::IOProphet factorized{ config };
+
+		for (size_t i = 0; i < 126; ++i) {
+			const blk_info_t info = builder.setSector(lbas[i % 7]).setSize(sizes[i % 3]).setTime(static_cast<double>(i)).setOp(0).build();
+			joint.insert(info);
+			factorized.insert(info);
+		}
+
+		ASSERT(factorized.getGrammarSize() < joint.getGrammarSize());
+		ASSERT(factorized.getPredictionStats().hits_ > joint.getPredictionStats().hits_);
+
+		// the next one is the 126th: LBA 800 and size 4096
+		const auto predictions = factorized.predict();
+		ASSERT_EQUAL(predictions.size(), 1ULL);
+		ASSERT_EQUAL(predictions.front().info_.lba(), 800ULL);
+		ASSERT_EQUAL(predictions.front().info_.size(), 4096ULL);
+		ASSERT_EQUAL(predictions.front().info_.type(), OPERATION::READ);
+
+		model::IOProphet::predict_pack_t ahead;
+		factorized.predictAhead(2, ahead);
+		ASSERT_EQUAL(ahead.size(), 2ULL);
+		ASSERT_EQUAL(ahead[1].info_.lba(), 16ULL);
+
+		// a batch learns both models the same way
+		model::IOProphet batched{ config };
+		std::vector<blk_info_t> batch;
+		for (size_t i = 0; i < 126; ++i) {
+			batch.push_back(builder.setSector(lbas[i % 7]).setSize(sizes[i % 3]).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+		batched.insert_batch(batch);
+		ASSERT_EQUAL(batched.getGrammarSize(), factorized.getGrammarSize());
+		// the grammar does not predict inside a batch, it is not counted
+		ASSERT_EQUAL(batched.getPredictionStats().requests_, 0ULL);
+		ASSERT(batched.predict() == predictions);
+		ASSERT(batched.memory_usage().contexts > 0);
+	}
+
+	void key_policy_test()
+	{
+		// the policies are pure, so a key is made and decoded at compile time
+		constexpr blk_info_t info = BlkInfoBuilder{}.setSector(123456).setSize(8192).setOp(1).build();
+		static_assert(keys::StandartKey::from_key(keys::StandartKey::to_key(info)).build().lba() == 123456);
+		static_assert(keys::StandartKey::from_key(keys::StandartKey::to_key(info)).build().size() == 8192);
+		static_assert(keys::DeltaKey::from_key(keys::DeltaKey::to_key(info, 200000), 200000).build().lba() == 123456);
+		static_assert(keys::SectorKey::to_key(info) == 123456);
+		static_assert(keys::OffsetKey::from_key(8192).build().size() == 8192);
+
+		// the old StandartKey cut the fields of the bitfield, the shifts keep the same keys
+		const blk_info_t far = BlkInfoBuilder{}.setSector((1ULL << 34) + 4096).setSize((1ULL << 34) + 512).setOp(0).build();
+		ASSERT_EQUAL(keys::StandartKey::to_key(far), (4096ULL / 8) << 33 | (512ULL / 8) << 2);
+
+		// every thread decodes its own predictions, so they all see the same ones
+		for (auto function : { model::key_function_t::STANDART, model::key_function_t::DELTA, model::key_function_t::INTERNED }) {
+			model::prophet_cfg_t config;
+			config.grammar_limits_ = 10000;
+			config.key_ = function;
+			config.stride_streams_ = 2;
+			model::IOProphet prophet{ config };
+
+			BlkInfoBuilder builder;
+			const std::array<uint64_t, 5> loop{ 9000, 40, 77000, 1200, 5000000 };
+			for (size_t i = 0; i < 500; ++i) {
+				prophet.insert(builder.setSector(loop[i % 5] + i / 50 * 8).setSize(4096 << i % 2).setTime(static_cast<double>(i)).setOp(i % 3 == 0).build());
+			}
+
+			const auto expected = prophet.predict();
+			model::IOProphet::predict_pack_t expected_ahead;
+			prophet.predictAhead(4, expected_ahead);
+			std::array<model::scored_prediction_t, 4> expected_top{};
+			const size_t expected_count = prophet.predict_top(expected_top);
+			ASSERT(!expected.empty());
+
+			std::atomic<size_t> mismatches{ 0 };
+			std::vector<std::thread> readers;
+			for (size_t i = 0; i < 4; ++i) {
+				readers.emplace_back([&] {
+					for (size_t j = 0; j < 200; ++j) {
+						model::IOProphet::predict_pack_t ahead;
+						prophet.predictAhead(4, ahead);
+						std::array<model::scored_prediction_t, 4> top{};
+						const size_t count = prophet.predict_top(top);
+						const bool is_same_top = count == expected_count && std::equal(top.cbegin(), top.cbegin() + count, expected_top.cbegin(), [](const auto& lhs, const auto& rhs) {
+							return lhs.info_ == rhs.info_ && lhs.confidence_ == rhs.confidence_;
+						});
+						if (prophet.predict() != expected || ahead != expected_ahead || !is_same_top) {
+							mismatches.fetch_add(1, std::memory_order_relaxed);
+						}
+					}
+				});
+			}
+			for (auto& reader : readers) {
+				reader.join();
+			}
+
+			ASSERT_EQUAL(mismatches.load(), 0ULL);
+		}
+	}
+
+	void quantile_sketch_test()
+	{
+		static_assert(sizeof(QuantileSketch) == QuantileSketch::BUCKETS);
+
+		// a quantile is within a bucket, a factor of sqrt(2), of the exact one
+		std::mt19937_64 gen{ 24 };
+		std::exponential_distribution<double> times{ 100.0 };
+		QuantileSketch sketch, first, second;
+		std::vector<double> values;
+		for (size_t i = 0; i < 200; ++i) {
+			const double x = times(gen);
+			values.push_back(x);
+			sketch.insert(x);
+			(i % 2 ? first : second).insert(x);
+		}
+		std::sort(values.begin(), values.end());
+		for (double q : { 0.5, 0.9, 0.99 }) {
+			const double exact = values[static_cast<size_t>(q * (values.size() - 1))];
+			ASSERT(sketch.quantile(q) >= exact / std::sqrt(2.0) && sketch.quantile(q) <= exact * std::sqrt(2.0));
+		}
+		ASSERT(sketch.quantile(0.5) <= sketch.quantile(0.9) && sketch.quantile(0.9) <= sketch.quantile(0.99));
+
+		// merged halves are the whole
+		first.merge(second);
+		ASSERT_EQUAL(first.count(), sketch.count());
+		ASSERT_EQUAL(first.quantile(0.9), sketch.quantile(0.9));
+
+		// the counters do not overflow, the old values fade away
+		for (size_t i = 0; i < 10000; ++i) {
+			sketch.insert(2.0);
+		}
+		ASSERT(sketch.count() <= QuantileSketch::BUCKETS * UINT8_MAX);
+		ASSERT(sketch.quantile(0.5) >= 2.0 && sketch.quantile(0.5) < 2.0 * std::sqrt(2.0));
+		ASSERT_EQUAL(QuantileSketch{}.quantile(0.5), 0.0);
+
+		// a rare tail survives the fading of the body
+		std::bernoulli_distribution tail{ 0.02 };
+		QuantileSketch rare, fading;
+		size_t lost = 0;
+		for (size_t i = 0; i < 20000; ++i) {
+			rare.insert(tail(gen) ? 100.0 : 1.0);
+			fading.insert(i % 50 == 0 ? 100.0 : 1.0);
+			if (i >= 1000) {
+				lost += rare.quantile(0.99) < 50.0;
+				ASSERT(fading.quantile(0.99) >= 50.0);
+			}
+		}
+		ASSERT(lost < 1000);
+
+		// a merge fades both sides alike
+		QuantileSketch full, other;
+		for (size_t i = 0; i < 255; ++i) {
+			full.insert(1.0);
+			other.insert(100.0);
+		}
+		full.merge(other);
+		ASSERT(full.quantile(0.25) < 2.0 && full.quantile(0.75) > 50.0);
+
+		// a loop of four requests, the step to the first one takes 1 or 10 seconds;
+		// as from BLKParser, the time of a request is the gap since the previous one
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 10000;
+		model::IOProphet prophet{ config };
+		BlkInfoBuilder builder;
+		for (size_t i = 0; i < 400; ++i) {
+			const double gap = i % 4 != 0 ? 0.5 : i % 8 == 0 ? 10.0 : 1.0;
+			prophet.insert(builder.setSector(i % 4 * 4096).setSize(4096).setTime(gap).setOp(0).build());
+		}
+
+		const auto predictions = prophet.predict();
+		ASSERT_EQUAL(predictions.size(), 1ULL);
+		const model::arrival_t& arrival = predictions.front().arrival_;
+		ASSERT_EQUAL(predictions.front().info_.lba(), 0ULL);
+		ASSERT(arrival.p50_ >= 1.0 && arrival.p50_ < 10.0);
+		ASSERT(arrival.p99_ >= 10.0 / std::sqrt(2.0) && arrival.p99_ <= 10.0 * std::sqrt(2.0));
+
+		// along a continuation the quantiles are summed up
+		model::IOProphet::predict_pack_t ahead;
+		prophet.predictAhead(2, ahead);
+		ASSERT_EQUAL(ahead.size(), 2ULL);
+		ASSERT(ahead[0].arrival_ == arrival);
+		ASSERT(ahead[1].arrival_.p50_ > arrival.p50_ + 0.5 / std::sqrt(2.0));
+		ASSERT(ahead[1].arrival_.p50_ < arrival.p50_ + 0.5 * std::sqrt(2.0));
+		ASSERT(ahead[1].arrival_.p99_ > arrival.p99_);
+	}
+
+	void pair_map_adapter_test()
+	{
+		// unbounded, it is a map of the pairs
+		utils::PairMapAdapter<uint64_t, uint64_t> map;
+		for (uint64_t i = 0; i < 1000; ++i) {
+			map(i, i + 1) = i;
+		}
+		ASSERT_EQUAL(map.size(), 1000ULL);
+		ASSERT_EQUAL(std::as_const(map)(10, 11), 10ULL);
+		ASSERT_EQUAL(std::as_const(map)(11, 10), 0ULL);
+		ASSERT(!map.contains(11, 10));
+
+		// bounded, the pairs updated between the turns of the hand stay
+		map.setCapacity(100);
+		ASSERT_EQUAL(map.size(), 100ULL);
+		ASSERT_EQUAL(map.evictions(), 900ULL);
+		for (uint64_t i = 0; i < 5000; ++i) {
+			map(0, 0) += 1;
+			map(7, 7) += 1;
+			map(10000 + i, 1) = i;
+			ASSERT(map.size() <= 100);
+		}
+		ASSERT_EQUAL(std::as_const(map)(0, 0), 5000ULL);
+		ASSERT_EQUAL(std::as_const(map)(7, 7), 5000ULL);
+		ASSERT_EQUAL(std::as_const(map)(14999, 1), 4999ULL);
+		ASSERT(!map.contains(10000, 1));
+
+		size_t visited = 0;
+		map.for_each([&visited](uint64_t, uint64_t, uint64_t) {
+			++visited;
+		});
+		ASSERT_EQUAL(visited, map.size());
+		map.clear();
+		ASSERT_EQUAL(map.size(), 0ULL);
+		map(1, 2) = 3;
+		ASSERT_EQUAL(std::as_const(map)(1, 2), 3ULL);
+
+		// a smaller capacity evicts the pairs that have not been updated first
+		utils::PairMapAdapter<uint64_t, uint64_t> shrunk;
+		shrunk.setCapacity(1000);
+		for (uint64_t i = 0; i < 1000; ++i) {
+			shrunk(i, 0) = i;
+		}
+		for (uint64_t i = 0; i < 1000; i += 2) {
+			shrunk(i, 0) += 1;
+		}
+		shrunk.setCapacity(500);
+		for (uint64_t i = 0; i < 1000; i += 2) {
+			ASSERT(shrunk.contains(i, 0));
+		}
+
+		// the time table of a prophet stops growing at its limit
+		model::prophet_cfg_t config;
+		config.grammar_limits_ = 1000000;
+		config.time_table_limit_ = 256;
+		model::IOProphet bounded{ config };
+		config.time_table_limit_ = 0;
+		model::IOProphet unbounded{ config };
+
+		std::mt19937_64 gen{ 25 };
+		BlkInfoBuilder builder;
+		for (size_t i = 0; i < 20000; ++i) {
+			const blk_info_t info = builder.setSector(gen() % 4096 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build();
+			bounded.insert(info);
+			unbounded.insert(info);
+		}
+		ASSERT(bounded.memory_usage().time_table * 8 < unbounded.memory_usage().time_table);
+		ASSERT_EQUAL(bounded.getGrammarSize(), unbounded.getGrammarSize());
+
+		// by default the table follows the grammar limit, 0 is the explicit opt-out
+		config.grammar_limits_ = 1000;
+		config.time_table_limit_ = model::prophet_cfg_t{}.time_table_limit_;
+		model::IOProphet derived{ config };
+		for (size_t i = 0; i < 20000; ++i) {
+			derived.insert(builder.setSector(gen() % 4096 * 8).setSize(4096).setTime(static_cast<double>(i)).setOp(0).build());
+		}
+		ASSERT(derived.memory_usage().time_table * 8 < unbounded.memory_usage().time_table);
+
+		// unbounded, the pairs cost less than the nodes of a tree
+		utils::PairMapAdapter<uint64_t, SketchedStats<double>> stats;
+		for (uint64_t i = 0; i < 100000; ++i) {
+			stats(gen() % 1000, i).insert(1.0);
+		}
+		ASSERT_EQUAL(stats.size(), 100000ULL);
+		using node_t = std::pair<const std::pair<uint64_t, uint64_t>, SketchedStats<double>>;
+		ASSERT(stats.bytes() < stats.size() * sequitur::tree_node_bytes<node_t>);
+	}
+
 	void groupTests(std::string_view blktrace_file, size_t head)
 	{
 		auto test_parse_write = [blktrace_file, head] { simple_parsing_write(blktrace_file, head); };
 		auto test_parse_read = [blktrace_file, head] { simple_parsing_read(blktrace_file, head); };
 		auto test_limits_set = [blktrace_file] { simple_limits_test(blktrace_file); };
+		auto test_digram_table = [] { digram_table_test(); };
+		auto test_small_set = [] { small_set_test(); };
+		auto test_flat_map = [] { flat_map_test(); };
+		auto test_compact_grammar = [] { compact_grammar_test(); };
+		auto test_grammar_eviction = [] { grammar_eviction_test(); };
+		auto test_insert_batch = [] { insert_batch_test(); };
+		auto test_snapshot = [] { snapshot_test(); };
+		auto test_sharded_prophet = [] { sharded_prophet_test(); };
+		auto test_published_predictions = [] { published_predictions_test(); };
+		auto test_cursor = [] { cursor_test(); };
+		auto test_predict_top = [] { predict_top_test(); };
+		auto test_object_pool = [] { object_pool_test(); };
+		auto test_memory_usage = [] { memory_usage_test(); };
+		auto test_memory_limit = [] { memory_limit_test(); };
+		auto test_memory_budget = [] { memory_budget_test(); };
+		auto test_context_engine = [] { context_engine_test(); };
+		auto test_stride_detector = [] { stride_detector_test(); };
+		auto test_delta_key = [] { delta_key_test(); };
+		auto test_interned_key = [] { interned_key_test(); };
+		auto test_region_levels = [] { region_levels_test(); };
+		auto test_factorized = [] { factorized_test(); };
+		auto test_key_policy = [] { key_policy_test(); };
+		auto test_quantile_sketch = [] { quantile_sketch_test(); };
+		auto test_pair_map_adapter = [] { pair_map_adapter_test(); };
 
 		jd::TestRunner runner;
 		RUN_TEST(runner, test_parse_write);
 		RUN_TEST(runner, test_parse_read);
 		RUN_TEST(runner, test_limits_set);
+		RUN_TEST(runner, test_digram_table);
+		RUN_TEST(runner, test_small_set);
+		RUN_TEST(runner, test_flat_map);
+		RUN_TEST(runner, test_compact_grammar);
+		RUN_TEST(runner, test_grammar_eviction);
+		RUN_TEST(runner, test_insert_batch);
+		RUN_TEST(runner, test_snapshot);
+		RUN_TEST(runner, test_sharded_prophet);
+		RUN_TEST(runner, test_published_predictions);
+		RUN_TEST(runner, test_cursor);
+		RUN_TEST(runner, test_predict_top);
+		RUN_TEST(runner, test_object_pool);
+		RUN_TEST(runner, test_memory_usage);
+		RUN_TEST(runner, test_memory_limit);
+		RUN_TEST(runner, test_memory_budget);
+		RUN_TEST(runner, test_context_engine);
+		RUN_TEST(runner, test_stride_detector);
+		RUN_TEST(runner, test_delta_key);
+		RUN_TEST(runner, test_interned_key);
+		RUN_TEST(runner, test_region_levels);
+		RUN_TEST(runner, test_factorized);
+		RUN_TEST(runner, test_key_policy);
+		RUN_TEST(runner, test_quantile_sketch);
+		RUN_TEST(runner, test_pair_map_adapter);
 	}
 }
 